@@ -0,0 +1,62 @@
+#include <string.h>
+#include "admitq.h"
+
+void admitq_init(struct admitq * aq, const int size){
+  memset(aq->queue, 0, sizeof(struct admission)*ADMITQ_MAX);
+  aq->head = 0;
+  aq->count = 0;
+  aq->size = (size >= 0 && size < ADMITQ_MAX) ? size : ADMITQ_MAX;
+}
+
+int admitq_enq(struct admitq * aq, const struct admission * a){
+  if(aq->count < aq->size){
+    aq->queue[(aq->head + aq->count++) % ADMITQ_MAX] = *a;
+    return aq->count - 1;
+  }else{
+    return -1;
+  }
+}
+
+//Pop oldest arrival
+int admitq_deq(struct admitq * aq, struct admission * a){
+  if(aq->count == 0){
+    return -1;
+  }
+  *a = aq->queue[aq->head];
+  aq->head = (aq->head + 1) % ADMITQ_MAX;
+  aq->count--;
+  return 0;
+}
+
+//Make room for a, by dropping the queued arrival of lowest class (highest index).
+//Returns -1 if a has lowest class itself, and should be dropped
+int admitq_shed(struct admitq * aq, const struct admission * a){
+
+  int i, low = -1;
+  for(i=0; i < aq->count; i++){
+    const int pos = (aq->head + i) % ADMITQ_MAX;
+    if( (aq->queue[pos].job_class > a->job_class) &&
+        ((low == -1) || (aq->queue[pos].job_class >= aq->queue[low].job_class))){
+      low = pos;
+    }
+  }
+
+  if(low == -1){
+    return -1;
+  }
+
+  //shift newer arrivals over the shed one, to keep arrival order
+  for(i=low; i != (aq->head + aq->count - 1) % ADMITQ_MAX; i = (i + 1) % ADMITQ_MAX){
+    aq->queue[i] = aq->queue[(i + 1) % ADMITQ_MAX];
+  }
+  aq->queue[i] = *a;
+  return 0;
+}
+
+int admitq_size(struct admitq * aq){
+  return aq->count;
+}
+
+int admitq_full(struct admitq * aq){
+  return aq->count >= aq->size;
+}
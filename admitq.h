@@ -0,0 +1,28 @@
+#include "master.h"
+
+//most arrivals that can wait for a pcb
+#define ADMITQ_MAX 1024
+//default bound, change with master -B
+#define ADMITQ_DEFAULT 32
+
+//arrival waiting for a free pcb
+struct admission {
+	struct vclock arrived;
+	int job_class;
+};
+
+struct admitq {
+	struct admission queue[ADMITQ_MAX];
+	int head;
+	int count;
+	int size;	/* bound on count */
+};
+
+void admitq_init(struct admitq * aq, const int size);
+
+int admitq_enq(struct admitq * aq, const struct admission * a);
+int admitq_deq(struct admitq * aq, struct admission * a);
+int admitq_shed(struct admitq * aq, const struct admission * a);
+
+int admitq_size(struct admitq * aq);
+int admitq_full(struct admitq * aq);
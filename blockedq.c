@@ -1,52 +1,83 @@
-#include <string.h>
+#include <stdlib.h>
 #include "blockedq.h"
 
-void blockedq_init(struct blockedq * bq){
-  memset(bq->queue, -1, sizeof(int)*MAX_USERS);
+int blockedq_init(struct blockedq * bq, const int size){
+  bq->heap = (struct blocked*) malloc(sizeof(struct blocked)*size);
+  if(bq->heap == NULL){
+    return -1;
+  }
   bq->count = 0;
+  bq->size = size;
+  return 0;
 }
 
-int blockedq_enq(struct blockedq * bq, const int p){
-  if(bq->count < MAX_USERS){
-    bq->queue[bq->count++] = p;
-    return bq->count - 1;
-  }else{
-    return -1;
-  }
+void blockedq_free(struct blockedq * bq){
+  free(bq->heap);
+  bq->heap = NULL;
+  bq->count = bq->size = 0;
 }
 
+int blockedq_enq(struct blockedq * bq, const int p, const uint64_t wake){
+  if(bq->count == bq->size){
+    return -1;
+  }
 
-static void blockedq_shift(struct blockedq * bq, const int pos){
-  int i;
-  for(i=pos; i < bq->count; i++){
-    bq->queue[i] = bq->queue[i+1];
+  //move parents down, until we find place of new item
+  int i = bq->count++;
+  while(i > 0){
+    const int parent = (i - 1) / 2;
+    if(bq->heap[parent].wake <= wake){
+      break;
+    }
+    bq->heap[i] = bq->heap[parent];
+    i = parent;
   }
-  bq->queue[i] = -1;
+  bq->heap[i].wake = wake;
+  bq->heap[i].p = p;
+  return i;
 }
 
-int blockedq_deq(struct blockedq * bq, const int pos){
-  const unsigned int pi = bq->queue[pos];
-  bq->count--;
-  blockedq_shift(bq, pos);
+//Remove earliest item
+static int blockedq_deq(struct blockedq * bq){
+  const int pi = bq->heap[0].p;
+  const struct blocked last = bq->heap[--bq->count];
+
+  //move smaller children up, until we find place of last item
+  int i = 0;
+  while(1){
+    int child = (2 * i) + 1;
+    if(child >= bq->count){
+      break;
+    }
+    if((child + 1 < bq->count) && (bq->heap[child + 1].wake < bq->heap[child].wake)){
+      child++;
+    }
+    if(last.wake <= bq->heap[child].wake){
+      break;
+    }
+    bq->heap[i] = bq->heap[child];
+    i = child;
+  }
+  bq->heap[i] = last;
   return pi;
 }
 
-// find user we can unblocked
-int blockedq_ready(struct blockedq * bq, const struct vclock * clock, const struct process * procs){
-  int i;
-  for(i=0; i < bq->count; i++){
-    const int pi = bq->queue[i];
-    if( (clock->sec > procs[pi].vclk[BLOCKED_TIME].sec) ||
-       ((clock->sec == procs[pi].vclk[BLOCKED_TIME].sec) && (clock->ns > procs[pi].vclk[BLOCKED_TIME].ns))
-      ){	//if our event time is reached
-      return blockedq_deq(bq, i);
-    }
+// find user we can unblock
+int blockedq_ready(struct blockedq * bq, const uint64_t now){
+  if((bq->count > 0) && (now > bq->heap[0].wake)){	//if our event time is reached
+    return blockedq_deq(bq);
   }
   return -1;
 }
 
+//user that wakes up first
 int blockedq_top(struct blockedq * bq){
-  return bq->queue[0];
+  return (bq->count) ? bq->heap[0].p : -1;
+}
+
+//when first user wakes up
+uint64_t blockedq_wake(struct blockedq * bq){
+  return (bq->count) ? bq->heap[0].wake : 0;
 }
 
 int blockedq_size(struct blockedq * bq){
@@ -1,17 +1,25 @@
 #include "master.h"
 
+//blocked process, and when it wakes up
+struct blocked {
+	uint64_t wake;	/* virtual ns */
+	int p;
+};
+
+//min-heap of blocked processes, by wake time
 struct blockedq {
-	int queue[MAX_USERS];
+	struct blocked * heap;
 	int count;
+	int size;	/* capacity of heap */
 };
 
-void blockedq_init(struct blockedq * bq);
-
-int blockedq_enq(struct blockedq * bq, const int p);
+int  blockedq_init(struct blockedq * bq, const int size);
+void blockedq_free(struct blockedq * bq);
 
-//int blockedq_deq(struct blockedq * bq, const int pos);
+int blockedq_enq(struct blockedq * bq, const int p, const uint64_t wake);
 int blockedq_top(struct blockedq * bq);
+uint64_t blockedq_wake(struct blockedq * bq);
 
 int blockedq_size(struct blockedq * bq);
 
-int blockedq_ready(struct blockedq * bq, const struct vclock * clock, const struct process * procs);
+int blockedq_ready(struct blockedq * bq, const uint64_t now);
@@ -0,0 +1,318 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/ipc.h>
+#include <sys/msg.h>
+#include <sys/wait.h>
+#include "master.h"
+#include "calibrate.h"
+
+//round trips in each measurement
+#define CALIBRATE_ROUNDS 20000
+//measurements, we keep the fastest
+#define CALIBRATE_REPEAT 5
+//buffer that evicts working set from caches
+#define CALIBRATE_EVICT (64 * 1024 * 1024)
+
+static uint64_t now_ns(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static int pin_cpu(const int cpu){
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  CPU_SET(cpu, &mask);
+  return sched_setaffinity(0, sizeof(cpu_set_t), &mask);
+}
+
+//Round trip of a message, between us and a child on same CPU. This includes the two switches
+static int calibrate_ipc(uint64_t * ns){
+
+  const int id = msgget(IPC_PRIVATE, IPC_CREAT | 0600);
+  if(id == -1){
+    perror("msgget");
+    return -1;
+  }
+
+  struct message m;
+  memset(&m, 0, sizeof(struct message));
+
+  const pid_t pid = fork();
+  if(pid == -1){
+    perror("fork");
+    msgctl(id, IPC_RMID, NULL);
+    return -1;
+  }else if(pid == 0){  //echo messages back, like a user
+    pin_cpu(0);
+    while(msgrcv(id, &m, MSG_SIZE, 1, 0) != -1){
+      m.mtype = 2;
+      msgsnd(id, &m, MSG_SIZE, 0);
+    }
+    exit(0);
+  }
+
+  pin_cpu(0);
+  int i, r, rv = 0;
+  *ns = ~0ULL;
+  for(r=0; (rv == 0) && (r < CALIBRATE_REPEAT); r++){
+    const uint64_t t0 = now_ns();
+    for(i=0; i < CALIBRATE_ROUNDS; i++){
+      m.mtype = 1;
+      if((msgsnd(id, &m, MSG_SIZE, 0) == -1) || (msgrcv(id, &m, MSG_SIZE, 2, 0) == -1)){
+        perror("msgsnd");
+        rv = -1;  //time of a partial run means nothing
+        break;
+      }
+    }
+    const uint64_t t = (now_ns() - t0) / CALIBRATE_ROUNDS;
+    if(t < *ns){
+      *ns = t;
+    }
+  }
+
+  msgctl(id, IPC_RMID, NULL);  //child gets an error and exits
+  waitpid(pid, NULL, 0);
+  return rv;
+}
+
+//Close ends of a pipe that are open
+static void pipe_close(int p[2]){
+  int i;
+  for(i=0; i < 2; i++){
+    if(p[i] != -1){
+      close(p[i]);
+      p[i] = -1;
+    }
+  }
+}
+
+//Switch cost, from pipe ping-pong of two processes on one CPU, without cost of pipe itself
+static int calibrate_switch(uint64_t * ns){
+
+  int ping[2] = {-1, -1}, pong[2] = {-1, -1};
+  char c = 0;
+  int i, r;
+
+  if((pipe(ping) == -1) || (pipe(pong) == -1)){
+    perror("pipe");
+    pipe_close(ping);
+    return -1;
+  }
+  pin_cpu(0);
+
+  //same reads and writes, in one process, don't switch
+  uint64_t self = ~0ULL;
+  for(r=0; r < CALIBRATE_REPEAT; r++){
+    const uint64_t t0 = now_ns();
+    for(i=0; i < CALIBRATE_ROUNDS; i++){
+      if( (write(ping[1], &c, 1) != 1) || (read(ping[0], &c, 1) != 1) ||
+          (write(pong[1], &c, 1) != 1) || (read(pong[0], &c, 1) != 1)){
+        perror("pipe");
+        pipe_close(ping);
+        pipe_close(pong);
+        return -1;
+      }
+    }
+    const uint64_t t = now_ns() - t0;
+    if(t < self){
+      self = t;
+    }
+  }
+
+  const pid_t pid = fork();
+  if(pid == -1){
+    perror("fork");
+    pipe_close(ping);
+    pipe_close(pong);
+    return -1;
+  }else if(pid == 0){
+    close(ping[1]); //so we see end of file, when parent closes it
+    close(pong[0]);
+    pin_cpu(0);
+    while(read(ping[0], &c, 1) == 1){
+      if(write(pong[1], &c, 1) != 1){
+        break;
+      }
+    }
+    exit(0);
+  }
+
+  uint64_t both = ~0ULL;
+  int rv = 0;
+  for(r=0; (rv == 0) && (r < CALIBRATE_REPEAT); r++){
+    const uint64_t t0 = now_ns();
+    for(i=0; i < CALIBRATE_ROUNDS; i++){
+      if((write(ping[1], &c, 1) != 1) || (read(pong[0], &c, 1) != 1)){
+        perror("pipe");
+        rv = -1;
+        break;
+      }
+    }
+    const uint64_t t = now_ns() - t0;
+    if(t < both){
+      both = t;
+    }
+  }
+
+  close(ping[1]); //child reads end of file and exits
+  ping[1] = -1;
+  waitpid(pid, NULL, 0);
+  pipe_close(ping);
+  pipe_close(pong);
+
+  //two switches in each round trip
+  *ns = (both > self) ? (both - self) / (2 * CALIBRATE_ROUNDS) : 0;
+  return rv;
+}
+
+//Walk a random cycle of cache lines, returns time it took
+static uint64_t chase(void ** start){
+  void ** p = start;
+  const uint64_t t0 = now_ns();
+  do{
+    p = (void**) *p;
+  }while(p != start);
+  return now_ns() - t0;
+}
+
+/* Extra time to walk working set after other processes evicted it, compared to a warm walk.
+   Simulated system has one CPU, so this is what a process pays when it runs again, not a migration */
+static int calibrate_cold(uint64_t * ns){
+
+  const int lines = CALIBRATE_SET / CACHE_LINE;
+  char * set = (char*) aligned_alloc(CACHE_LINE, CALIBRATE_SET);
+  int * order = (int*) malloc(sizeof(int)*lines);
+  if((set == NULL) || (order == NULL)){
+    perror("malloc");
+    free(set);
+    free(order);
+    return -1;
+  }
+
+  //link lines in random order, so prefetcher can't guess next one
+  unsigned short seed[3] = {0x330E, 0xCA1B, 0x0001};
+  int i, r;
+  for(i=0; i < lines; i++){
+    order[i] = i;
+  }
+  for(i=lines - 1; i > 0; i--){
+    const int j = nrand48(seed) % (i + 1);
+    const int t = order[i];
+    order[i] = order[j];
+    order[j] = t;
+  }
+  for(i=0; i < lines; i++){
+    *(void**)&set[order[i] * CACHE_LINE] = &set[order[(i + 1) % lines] * CACHE_LINE];
+  }
+  void ** start = (void**) &set[order[0] * CACHE_LINE];
+
+  char * evict = (char*) malloc(CALIBRATE_EVICT);
+  if(evict == NULL){
+    perror("malloc");
+    free(order);
+    free(set);
+    return -1;
+  }
+  pin_cpu(0);
+
+  uint64_t warm = ~0ULL, cold = ~0ULL;
+  for(r=0; r < CALIBRATE_REPEAT; r++){
+    chase(start);
+    uint64_t t = chase(start);
+    if(t < warm){
+      warm = t;
+    }
+
+    memset(evict, r, CALIBRATE_EVICT); //stands in for other processes running
+    t = chase(start);
+    if(t < cold){
+      cold = t;
+    }
+  }
+
+  *ns = (cold > warm) ? cold - warm : 0;
+  free(evict);
+  free(order);
+  free(set);
+  return 0;
+}
+
+//Measure costs of this host
+int calibrate_run(struct cost_profile * cp){
+
+  //measure on one CPU, and put back how we were
+  cpu_set_t old;
+  sched_getaffinity(0, sizeof(cpu_set_t), &old);
+
+  const int rv = ( (calibrate_ipc(&cp->ipc) < 0) ||
+                   (calibrate_switch(&cp->cswitch) < 0) ||
+                   (calibrate_cold(&cp->cold) < 0)) ? -1 : 0;
+
+  sched_setaffinity(0, sizeof(cpu_set_t), &old);
+
+  //dispatch cost adds switches on its own, so ipc is just the message queue
+  cp->ipc = (cp->ipc > 2*cp->cswitch) ? cp->ipc - 2*cp->cswitch : 0;
+  return rv;
+}
+
+int cost_save(const struct cost_profile * cp, const char * path){
+
+  FILE * fp = fopen(path, "w");
+  if(fp == NULL){
+    perror("fopen");
+    return -1;
+  }
+
+  fprintf(fp, "# Cost profile from master -C, in ns\n");
+  fprintf(fp, "ipc %lu\n", (unsigned long) cp->ipc);
+  fprintf(fp, "switch %lu\n", (unsigned long) cp->cswitch);
+  fprintf(fp, "cold %lu\n", (unsigned long) cp->cold);
+  fclose(fp);
+  return 0;
+}
+
+int cost_load(struct cost_profile * cp, const char * path){
+
+  FILE * fp = fopen(path, "r");
+  if(fp == NULL){
+    perror("fopen");
+    return -1;
+  }
+
+  memset(cp, 0, sizeof(struct cost_profile));
+
+  char line[128], key[32];
+  unsigned long val;
+  int n = 0, rv = 0;
+  while((rv == 0) && fgets(line, sizeof(line), fp)){
+    n++;
+    if((line[0] == '#') || (line[0] == '\n')){
+      continue;
+    }
+
+    if(sscanf(line, "%31s %lu", key, &val) != 2){
+      rv = -1;
+    }else if(strcmp(key, "ipc") == 0){
+      cp->ipc = val;
+    }else if(strcmp(key, "switch") == 0){
+      cp->cswitch = val;
+    }else if(strcmp(key, "cold") == 0){
+      cp->cold = val;
+    }else{
+      rv = -1;
+    }
+  }
+  fclose(fp);
+
+  if(rv < 0){
+    fprintf(stderr, "Error: Invalid cost setting at %s:%d\n", path, n);
+  }
+  return rv;
+}
@@ -0,0 +1,15 @@
+#include <stdint.h>
+
+/* Costs of this host, measured by master -C and applied by master -k */
+struct cost_profile {
+	uint64_t ipc;	/* message queue round trip between master and user, without the switches, in ns */
+	uint64_t cswitch;	/* switch between two processes on one CPU */
+	uint64_t cold;	/* refill of a working set from memory, after other processes evicted it */
+};
+
+//working set of a process, refilled when its cache is cold
+#define CALIBRATE_SET (512 * 1024)
+
+int calibrate_run(struct cost_profile * cp);
+int cost_save(const struct cost_profile * cp, const char * path);
+int cost_load(struct cost_profile * cp, const char * path);
@@ -0,0 +1,91 @@
+#include <string.h>
+#include "device.h"
+
+void device_init(struct device * dev, const struct device_spec * spec){
+  memset(dev, 0, sizeof(struct device));
+  dev->spec = spec;
+  dev->busy = -1;
+  dev->up = 1;
+}
+
+//Add request to device queue
+int device_submit(struct device * dev, const struct device_request * r){
+  if(dev->count == MAX_USERS){
+    return -1;
+  }
+
+  dev->queue[dev->count++] = *r;
+  if(dev->count > dev->max_count){
+    dev->max_count = dev->count;
+  }
+  return 0;
+}
+
+//Find nearest request in direction of elevator, or -1
+static int device_nearest(struct device * dev, const int up){
+  int i, best = -1;
+  for(i=0; i < dev->count; i++){
+    const unsigned int t = dev->queue[i].track;
+    if(up ? (t < dev->head) : (t > dev->head)){
+      continue;
+    }
+    if((best == -1) || (up ? (t < dev->queue[best].track) : (t > dev->queue[best].track))){
+      best = i;
+    }
+  }
+  return best;
+}
+
+//Pick next request, and remove it from queue
+static void device_pick(struct device * dev, struct device_request * r){
+
+  int pos = 0;  //fifo takes the oldest
+  if(dev->spec->policy == DEVICE_ELEVATOR){
+    pos = device_nearest(dev, dev->up);
+    if(pos == -1){  //nothing left in this direction, turn around
+      dev->up = !dev->up;
+      pos = device_nearest(dev, dev->up);
+    }
+  }
+
+  *r = dev->queue[pos];
+  dev->count--;
+  memmove(&dev->queue[pos], &dev->queue[pos + 1], sizeof(struct device_request)*(dev->count - pos));
+}
+
+//If device is idle, start next request at now, or when it was made. Returns -1 if device is busy, or has no requests
+int device_start(struct device * dev, const uint64_t now, struct device_request * r, uint64_t * finish){
+
+  if((dev->busy != -1) || (dev->count == 0)){
+    return -1;
+  }
+  device_pick(dev, r);
+
+  //seek from last track
+  const unsigned int dist = (r->track > dev->head) ? r->track - dev->head : dev->head - r->track;
+  const uint64_t service = r->service + (uint64_t)(dist * dev->spec->seek);
+  dev->head = r->track;
+
+  //request can be newer than end of previous one, which we learn about late
+  const uint64_t start = (now > r->requested) ? now : r->requested;
+  const uint64_t wait = start - r->requested;
+  dev->wait_ns += wait;
+  if(wait > dev->wait_max){
+    dev->wait_max = wait;
+  }
+  dev->busy_ns += service;
+  dev->served++;
+
+  dev->busy = r->p;
+  *finish = start + service;
+  return 0;
+}
+
+//Request in service is finished
+void device_done(struct device * dev){
+  dev->busy = -1;
+}
+
+int device_size(struct device * dev){
+  return dev->count;
+}
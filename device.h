@@ -0,0 +1,34 @@
+#include "master.h"
+
+//IO request of a process, waiting for or in service on a device
+struct device_request {
+	int p;	/* pcb index */
+	unsigned int track;
+	uint64_t requested;	/* virtual ns, when process blocked */
+	uint64_t service;	/* transfer time, without seek */
+};
+
+struct device {
+	const struct device_spec * spec;
+
+	struct device_request queue[MAX_USERS];	/* waiting requests, in arrival order */
+	int count;
+
+	int busy;	/* pcb in service, or -1 */
+	unsigned int head;	/* track of last request */
+	int up;	/* elevator moves to higher tracks */
+
+	/* stats */
+	unsigned int served;
+	int max_count;
+	uint64_t busy_ns;
+	uint64_t wait_ns, wait_max;	/* queueing delay, before service starts */
+};
+
+void device_init(struct device * dev, const struct device_spec * spec);
+
+int device_submit(struct device * dev, const struct device_request * r);
+int device_start(struct device * dev, const uint64_t now, struct device_request * r, uint64_t * finish);
+void device_done(struct device * dev);
+
+int device_size(struct device * dev);
@@ -0,0 +1,84 @@
+#include <math.h>
+#include <string.h>
+#include "estimate.h"
+
+//Student t quantile for 95% two-sided interval, by degrees of freedom
+static const double t95[] = { 0.0,
+  12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+   2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+   2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+
+void estimate_init(struct estimate * e){
+  memset(e, 0, sizeof(struct estimate));
+  e->batch_size = 1;
+}
+
+//merge pairs of batches, so we have half as many, of double size
+static void estimate_merge(struct estimate * e){
+  unsigned int i;
+  for(i=0; i < e->nbatches / 2; i++){
+    e->batch[i] = (e->batch[2*i] + e->batch[2*i + 1]) / 2.0;
+  }
+  e->nbatches /= 2;
+  e->batch_size *= 2;
+}
+
+void estimate_add(struct estimate * e, const double x){
+
+  //Welford update
+  e->n++;
+  const double delta = x - e->mean;
+  e->mean += delta / e->n;
+  e->m2   += delta * (x - e->mean);
+
+  e->batch_sum += x;
+  if(++e->in_batch < e->batch_size){
+    return;
+  }
+
+  e->batch[e->nbatches++] = e->batch_sum / e->batch_size;
+  e->batch_sum = 0.0;
+  e->in_batch = 0;
+
+  if(e->nbatches == ESTIMATE_BATCHES){
+    estimate_merge(e);
+  }
+}
+
+double estimate_stddev(const struct estimate * e){
+  return (e->n > 1) ? sqrt(e->m2 / (e->n - 1)) : 0.0;
+}
+
+//Half width of 95% interval of the mean. Returns -1 if there are too few batches
+int estimate_interval(const struct estimate * e, double * half){
+
+  const unsigned int k = e->nbatches;
+  if(k < ESTIMATE_BATCHES / 2){
+    return -1;
+  }
+
+  //variance of batch means
+  double mean = 0.0, m2 = 0.0;
+  unsigned int i;
+  for(i=0; i < k; i++){
+    const double delta = e->batch[i] - mean;
+    mean += delta / (i + 1);
+    m2   += delta * (e->batch[i] - mean);
+  }
+
+  const unsigned int df = k - 1;
+  const double t = (df < sizeof(t95) / sizeof(t95[0])) ? t95[df] : 1.960;
+  *half = t * sqrt(m2 / df / k);
+  return 0;
+}
+
+//Check if interval is within precision, relative to the mean
+int estimate_converged(const struct estimate * e, const double precision){
+  double half;
+  if( (e->batch_size < ESTIMATE_MIN_BATCH) ||
+      (estimate_interval(e, &half) < 0) ||
+      (e->mean <= 0.0)){
+    return 0;
+  }
+  return (half / e->mean) <= precision;
+}
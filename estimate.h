@@ -0,0 +1,29 @@
+#include <stdint.h>
+
+/* Online estimate of a mean, with a 95% confidence interval from batch means.
+   When all batches are used, pairs are merged and batch size doubles,
+   so batches get longer than the correlation between observations */
+
+//batches kept, between half of this and all of it
+#define ESTIMATE_BATCHES 32
+//observations in a batch, before interval is used to stop a run
+#define ESTIMATE_MIN_BATCH 8
+
+struct estimate {
+	uint64_t n;	/* Welford mean and sum of squared differences, over all observations */
+	double mean;
+	double m2;
+
+	double batch[ESTIMATE_BATCHES];	/* means of complete batches */
+	unsigned int nbatches;
+	uint64_t batch_size;
+	uint64_t in_batch;	/* observations in current batch */
+	double batch_sum;
+};
+
+void estimate_init(struct estimate * e);
+void estimate_add(struct estimate * e, const double x);
+
+double estimate_stddev(const struct estimate * e);
+int estimate_interval(const struct estimate * e, double * half);
+int estimate_converged(const struct estimate * e, const double precision);
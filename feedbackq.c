@@ -1,19 +1,39 @@
+#include <stdlib.h>
 #include <string.h>
 #include "feedbackq.h"
 
-static void feedbackq_zero(struct feedbackq  * fq, const int q){
-  memset(fq->queue, -1, sizeof(int)*MAX_USERS);
+static int feedbackq_zero(struct feedbackq  * fq, const int size, const int q){
+  fq->queue = (int*) malloc(sizeof(int)*size);
+  if(fq->queue == NULL){
+    return -1;
+  }
+  memset(fq->queue, -1, sizeof(int)*size);
 
+  fq->head = 0;
   fq->count = 0;
+  fq->size = size;
   fq->quant = q;
+  return 0;
 }
 
-void feedbackq_init(struct feedbackq  fq[FEEDBACK_LEVELS]){
+int feedbackq_init(struct feedbackq  fq[FEEDBACK_LEVELS], const int size){
   int i, q = QUANTUM_NS;
-  for(i=1; i < FEEDBACK_LEVELS; i++){
-    feedbackq_zero(&fq[i], q);
+  for(i=0; i < FEEDBACK_LEVELS; i++){
+    if(feedbackq_zero(&fq[i], size, q) < 0){
+      return -1;
+    }
     q *= 2; //next q gets half the quantum
   }
+  return 0;
+}
+
+void feedbackq_free(struct feedbackq  fq[FEEDBACK_LEVELS]){
+  int i;
+  for(i=0; i < FEEDBACK_LEVELS; i++){
+    free(fq[i].queue);
+    fq[i].queue = NULL;
+    fq[i].count = fq[i].size = 0;
+  }
 }
 
 
@@ -22,7 +42,11 @@ int feedbackq_ready(struct feedbackq  fq[FEEDBACK_LEVELS], const struct process
   int i;
   for(i=0; i < FEEDBACK_LEVELS; i++){
 
-    const int pi = fq[i].queue[0];
+    if(fq[i].count == 0){
+      continue;
+    }
+
+    const int pi = fq[i].queue[fq[i].head];
     if(procs[pi].state == READY){    /* if process is ready */
       return i;
     }
@@ -32,32 +56,30 @@ int feedbackq_ready(struct feedbackq  fq[FEEDBACK_LEVELS], const struct process
 
 
 int feedbackq_enq(struct feedbackq  * fq, const int pi){
-  if(fq->count < MAX_USERS){
-    fq->queue[fq->count++] = pi;
+  if(fq->count < fq->size){
+    fq->queue[(fq->head + fq->count++) % fq->size] = pi;
     return fq->count - 1;
   }else{
     return -1;
   }
 }
 
-//Pop item at pos, from queue
-int feedbackq_deq(struct feedbackq  * fq, const int pos){
+//Pop first item from queue
+int feedbackq_deq(struct feedbackq  * fq){
+  if(fq->count == 0){
+    return -1;
+  }
 
-  const unsigned int pi = fq->queue[pos];
+  const int pi = fq->queue[fq->head];
+  fq->queue[fq->head] = -1;
+  fq->head = (fq->head + 1) % fq->size;
   fq->count--;
 
-  //shift queue left
-  int i;
-  for(i=pos; i < fq->count; i++){
-    fq->queue[i] = fq->queue[i+1];
-  }
-  fq->queue[i] = -1;
-
   return pi;
 }
 
 int feedbackq_top(struct feedbackq  * fq){
-  return fq->queue[0];
+  return (fq->count) ? fq->queue[fq->head] : -1;
 }
 
 unsigned int feedbackq_quant(struct feedbackq  * fq){
@@ -1,4 +1,6 @@
+#define _GNU_SOURCE
 #include <time.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -11,71 +13,185 @@
 #include <sys/shm.h>
 #include <sys/msg.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sched.h>
+#include <dirent.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <assert.h>
 
 #include "master.h"
 #include "blockedq.h"
 #include "feedbackq.h"
+#include "admitq.h"
+#include "stats.h"
+#include "trace.h"
+#include "profile.h"
+#include "output.h"
+#include "spscq.h"
+#include "estimate.h"
+#include "device.h"
+#include "calibrate.h"
+#include "pcbmap.h"
+#include "thread.h"
 
 //maximum time to run
 #define MAX_RUNTIME 3
 //maximum children to create
 #define MAX_CHILDREN 100
+//maximum children to create, when run stops on precision
+#define MAX_CHILDREN_ESTIMATE 100000
+//virtual time in one utilisation sample
+#define UTIL_WINDOW_NS 100000000ULL
+//arrivals generated ahead by arrival thread
+#define ARRIVAL_RING 64
+//users spawned ahead by arrival thread, waiting for an admission
+#define USER_SPARE 8
 
 //Our program options
 static unsigned int arg_c = 5;
 static char * arg_l = NULL;
 static unsigned int arg_t = MAX_RUNTIME;
-
-static pid_t childpids[MAX_CHILDREN];  //array for user pids
-static unsigned int C = 0;
+static unsigned int arg_p = 0;  //use POSIX shared memory
+static unsigned int arg_H = 0;  //use huge pages for shared memory
+static unsigned int arg_r = 0;  //real execution mode
+static unsigned int arg_a = 0;  //pin users to CPUs
+static char * arg_T = NULL;     //timeline trace filename
+static char * arg_w = NULL;     //workload filename
+static unsigned int arg_P = 0;  //pipeline of arrival, dispatch and output threads
+static unsigned int arg_n = 0;  //maximum children, 0 for default
+static double arg_e = 0.0;      //stop when intervals are within this fraction of mean
+static char * arg_C = NULL;     //measure host costs and save them to this file
+static char * arg_k = NULL;     //cost profile for dispatch overhead
+
+//what to do with arrival when admission queue is full
+enum admit_policy { ADMIT_DROP=0, ADMIT_BLOCK, ADMIT_SHED };
+static const char * admit_policy_names[] = {"drop", "block", "shed"};
+static enum admit_policy arg_A = ADMIT_DROP;
+static int arg_B = ADMITQ_DEFAULT;
+
+static unsigned int C = 0;  //children created
 static int shmid = -1, msgid = -1;    //shared memory and msg queue ids
+static char shmid_arg[16], msgid_arg[16]; //same ids, passed to users in argv
+#define USER_ARGS 8
 static unsigned int interrupted = 0;
 
 static FILE * output = NULL;
 static struct shared * shmp = NULL; //pointer to shared memory
+static char shm_name[SHM_NAME_LEN];  //POSIX shared memory name
 
 static struct feedbackq fq[FEEDBACK_LEVELS];  //multi-level feedback queue
 static struct blockedq bq;        //blocked queue
+static struct admitq aq;          //arrivals waiting for a pcb
+static struct device devices[MAX_DEVICES];  //IO devices, with -w
+static unsigned short device_seed[3] = {0x330E, 0xD15C, 0x0001};
+
+static struct pcbmap pm;          //free pcbs
+
+//cold times of a pcb, kept apart from its hot fields
+#define PCB_VCLK(pcb) shmp->times[(pcb) - shmp->procs].vclk
+
+//real mode - quantum timer and the process it preempts
+static timer_t quantum_timer;
+static struct process * running = NULL;
+static volatile sig_atomic_t quantum_expired = 0;
+static uint64_t real_cpu_ns = 0, real_ready_ns = 0, real_dispatch_ns = 0;
+
+enum stat_times {IDLE_TIME, STAT_TIMES_COUNT};
+static struct vclock vclk_stat[STAT_TIMES_COUNT];
+static int idling = 0;                  //CPU has no ready process
+static struct vclock idle_vclock = {0,0};  //since when
+static struct stats st;   //records of completed processes
+static struct workload wl;  //arrivals and job classes, with -w
+static unsigned int arrivals = 0;
+
+//arrival - its job class, and time to next arrival
+struct arrival {
+  uint64_t inc;
+  int job_class;
+};
+static unsigned short arrival_seed[3] = {0x330E, 0x5EED, 0x0001}; //arrivals without workload
+
+//pipeline mode - arrival thread fills rings, dispatcher takes from them
+static struct spscq arrival_ring, user_ring;
+static pthread_t arrival_tid;
+static atomic_int arrival_stopping = 0;
+static int arrival_started = 0;
+
+//online estimates of the metrics, to stop once they are precise enough
+enum estimate_metric { EST_TURNAROUND=0, EST_WAIT, EST_UTIL, EST_COUNT };
+static const char * estimate_names[EST_COUNT] = {"Turnaround Time", "Wait Time", "CPU Utilisation"};
+static struct estimate est[EST_COUNT];
+static int est_updated = 0, est_done = 0;
+static uint64_t busy_ns = 0, util_mark = 0, util_window_end = UTIL_WINDOW_NS;
+
+//dispatch overhead from cost profile, instead of a random one
+static struct cost_profile costs;
+static int last_id = -1;  //process that ran last
+static unsigned char pcb_cold[MAX_USERS]; //process blocked, its cache is gone if others run before it
+static unsigned int dispatches = 0, switches = 0, cold_starts = 0;
+
+//admission stats
+static unsigned int admitted = 0, dropped = 0, shed = 0;
+static uint64_t admit_latency_sum = 0, admit_latency_max = 0;
+static uint64_t pcb_freed_ns = 0;  //when a pcb was last released
+static int pcb_idle = 0;           //pcbs that were free before last burst started
+
+//Write a line to log file
+static void master_log(const char * fmt, ...) __attribute__((format(printf, 1, 2)));
+static void master_log(const char * fmt, ...)
+{
+  PROF_BEGIN(PROF_LOG);
 
-static unsigned int pcb_bitmap = 0;
+  //output thread carries integers only, catch other formats in every mode
+  assert(output_format_ok(fmt));
 
-enum stat_times {IDLE_TIME, TURN_TIME, WAIT_TIME, SLEEP_TIME};
-static struct vclock vclk_stat[4];
+  va_list ap;
+  va_start(ap, fmt);
+  if(arg_P){
+    output_log(fmt, ap);  //formatted by output thread
+  }else{
+    vfprintf(output, fmt, ap);
+  }
+  va_end(ap);
+  PROF_END(PROF_LOG);
+}
 
 //Called when we receive a signal
 static void sign_handler(const int sig)
 {
   interrupted = 1;
+  if(shmp == NULL){ //before shared memory, or in calibration
+    fprintf(output, "Signal %i received\n", sig);
+    return;
+  }
 	fprintf(output, "[%u:%u] Signal %i received\n", shmp->vclk.sec, shmp->vclk.ns, sig);
 }
 
-//return 0 or 1 bot bit n from pcb bitmap
-static int bit_status(const int n){
-  return ((pcb_bitmap & (1 << n)) >> n);
-}
-
-//find first available pcb
-static int unused_pcb(){
-	int i;
-  for(i=0; i < MAX_USERS; i++){
-  	if(bit_status(i) == 0){
-			pcb_bitmap ^= (1 << i);	//raise the bit
-      return i;
-    }
+//Called when quantum of running process expires, in real mode
+static void quantum_handler(const int sig)
+{
+  if(running){
+    running->preempt = 1;
   }
-  return -1;
+  quantum_expired = 1;
 }
 
 //mark a pcb as unused
 void pcb_release(struct process * procs, const unsigned int i){
 
-  pcb_bitmap ^= (1 << i); //switch bit
+  pcbmap_put(&pm, i);
+  pcb_freed_ns = VCLOCK_NS(shmp->vclk);
   bzero(&shmp->procs[i], sizeof(struct process));
+  bzero(&shmp->times[i], sizeof(struct pcb_times));
+  pcb_cold[i] = 0;
 }
 
 
 struct process * pcb_get(){
-	const int i = unused_pcb();
+	const int i = pcbmap_get(&pm);
 	if(i == -1){
 		return NULL;
 	}
@@ -85,112 +201,451 @@ struct process * pcb_get(){
 	return &shmp->procs[i];
 }
 
-//Create a child process
-static pid_t master_fork(const char *prog)
+//Pin user to a CPU, round robin
+static void user_pin(const pid_t pid, const unsigned int n){
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  CPU_SET(n % sysconf(_SC_NPROCESSORS_ONLN), &mask);
+  if(sched_setaffinity(pid, sizeof(cpu_set_t), &mask) == -1){
+    perror("sched_setaffinity");
+  }
+}
+
+//Fill the user program arguments
+static void user_args(const char * prog, char * args[USER_ARGS]){
+  int n = 0;
+  args[n++] = (char*) prog;
+  if(arg_p){
+    args[n++] = "-p";
+  }else{
+    args[n++] = "-s";
+    args[n++] = shmid_arg;
+  }
+  args[n++] = "-q";
+  args[n++] = msgid_arg;
+  if(arg_r){
+    args[n++] = "-r";
+  }
+  args[n] = NULL;
+}
+
+//Start a spare user from arrival thread. It waits for its first message, until admitted
+static pid_t user_spawn(const char * prog){
+
+  char * args[USER_ARGS];
+  user_args(prog, args);
+
+  //our thread has signals blocked, user must not inherit that
+  sigset_t none;
+  sigemptyset(&none);
+
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setsigmask(&attr, &none);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+  pid_t pid;
+  const int rv = posix_spawn(&pid, prog, NULL, &attr, args, environ);
+  posix_spawnattr_destroy(&attr);
+  if(rv != 0){
+    errno = rv;
+    perror("posix_spawn");
+    return -1;
+  }
+  return pid;
+}
+
+//Stop a spare user, that was never admitted
+static void user_discard(const pid_t pid){
+  if(pid <= 0){
+    return;
+  }
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+}
+
+//Create a child process for pcb, unless arrival thread spawned it already
+static pid_t master_fork(const char *prog, struct process * pcb, pid_t pid)
 {
 
-  struct process *pcb = pcb_get();
-  if(pcb == NULL){
-    fprintf(output, "Warning: No pcb available\n");
-    return 0; //no free processes
+  if(pid == 0){
+    pid = fork();  //create process
+    if(pid < 0){
+      perror("fork");
+    }
+  }else if((pid > 0) && arg_a){
+    user_pin(pid, C);
   }
 
-	const pid_t pid = fork();  //create process
 	if(pid < 0){
-		perror("fork");
+    pcb_release(shmp->procs, pcb - shmp->procs);
 		return -1;
 
 	}else if(pid == 0){
+
+    if(arg_a){
+      user_pin(0, C);
+    }
+
+    char * args[USER_ARGS];
+    user_args(prog, args);
+
     //run the specified program
-		execl(prog, prog, NULL);
-		perror("execl");
+		execv(prog, args);
+		perror("execv");
 		exit(1);
 
 	}else{
     pcb->pid = pid;
-    VCLOCK_COPY(pcb->vclk[READY_TIME], shmp->vclk);
-    VCLOCK_COPY(pcb->vclk[FORK_TIME],  shmp->vclk);
+    VCLOCK_COPY(PCB_VCLK(pcb)[READY_TIME], shmp->vclk);
+    VCLOCK_COPY(PCB_VCLK(pcb)[FORK_TIME],  shmp->vclk);
 
     const int pcb_index = pcb - shmp->procs; //process index
     const int rv = feedbackq_enq(&fq[0], pcb_index);
     if(rv < 0){
       fprintf(stderr, "[%i: %i] Error: Queueing process with PID %d failed\n", shmp->vclk.sec, shmp->vclk.ns, pcb->pid);
     }else{
-      fprintf(output,"[%u:%u] Master: Generating process with PID %u and putting it in queue 0\n", shmp->vclk.sec, shmp->vclk.ns, pcb->id);
+      master_log("[%u:%u] Master: Generating process with PID %u and putting it in queue 0\n", shmp->vclk.sec, shmp->vclk.ns, pcb->id);
     }
-
-    //save child pid
-		childpids[C++] = pid;
+    trace_name(pcb->id);
+    C++;
 	}
 	return pid;
 }
 
-//Wait for all processes to exit
+//Reap the processes that exited
 static void master_waitall()
 {
+  int status;
+  pid_t pid;
+  while((pid = waitpid(-1, &status, WNOHANG)) > 0){
+
+    if (WIFEXITED(status)) {  //if process exited
+
+      master_log("Master: Child %u terminated with %i at %u:%u\n",
+        pid, WEXITSTATUS(status), shmp->vclk.sec, shmp->vclk.ns);
+
+    }else if(WIFSIGNALED(status)){  //if process was signalled
+      master_log("Master: Child %u killed with signal %d at system time at %u:%u\n",
+        pid, WTERMSIG(status), shmp->vclk.sec, shmp->vclk.ns);
+    }
+  }
+}
+
+//Generate next arrival. Its own random stream, so arrivals are the same with or without -P
+static void arrival_generate(struct arrival * a)
+{
+  static const int maxTimeBetweenNewProcsSecs = 1;
+  static const int maxTimeBetweenNewProcsNS = 500000;
+
+  if(arg_w){
+    a->inc = workload_next_arrival(&wl);
+    a->job_class = workload_pick_class(&wl);
+  }else{
+    a->inc  = (nrand48(arrival_seed) % maxTimeBetweenNewProcsSecs) * 1000000000ULL;
+    a->inc += (nrand48(arrival_seed) % maxTimeBetweenNewProcsNS);
+    a->job_class = 0;
+  }
+}
+
+//Arrival thread - generate arrivals and spawn spare users ahead of dispatcher
+static void * arrival_thread(void * arg)
+{
+  struct arrival a;
+  int have_arrival = 0;
+  pid_t pid = 0;
+
+  while(!arrival_stopping){
+    int idle = 1;
+
+    if(!have_arrival){
+      arrival_generate(&a);
+      have_arrival = 1;
+    }
+    if(spscq_push(&arrival_ring, &a) == 0){
+      have_arrival = 0;
+      idle = 0;
+    }
+
+    if(pid == 0){
+      pid = user_spawn("./user");
+    }
+    if(spscq_push(&user_ring, &pid) == 0){
+      pid = 0;
+      idle = 0;
+    }
+
+    if(idle){ //both rings are full
+      usleep(100);
+    }
+  }
+
+  user_discard(pid);
+  return NULL;
+}
+
+static int arrival_start()
+{
+  if( (spscq_init(&arrival_ring, ARRIVAL_RING, sizeof(struct arrival)) < 0) ||
+      (spscq_init(&user_ring, USER_SPARE, sizeof(pid_t)) < 0)){
+    perror("malloc");
+    return -1;
+  }
+
+  if(thread_start(&arrival_tid, arrival_thread) < 0){
+    spscq_free(&arrival_ring);
+    spscq_free(&user_ring);
+    return -1;
+  }
+  arrival_started = 1;
+  return 0;
+}
+
+//Stop arrival thread, and the spare users
+static void arrival_stop()
+{
+  if(!arrival_started){
+    return;
+  }
+
+  arrival_stopping = 1;
+  pthread_join(arrival_tid, NULL);
+
+  pid_t pid;
+  while(spscq_pop(&user_ring, &pid) == 0){
+    user_discard(pid);
+  }
+  spscq_free(&arrival_ring);
+  spscq_free(&user_ring);
+  arrival_started = 0;
+}
+
+//Take next arrival, from arrival thread in pipeline mode
+static void arrival_next(struct arrival * a)
+{
+  if(arg_P){
+    while(spscq_pop(&arrival_ring, a) < 0){
+      sched_yield();
+    }
+  }else{
+    arrival_generate(a);
+  }
+}
+
+//Take a spare user, spawned by arrival thread
+static pid_t user_take()
+{
+  pid_t pid;
+  while(spscq_pop(&user_ring, &pid) < 0){
+    sched_yield();  //arrival thread is spawning it
+  }
+  return pid;
+}
+
+//Show min and max of a completed process stat
+static void output_range(const char * name, const struct stats_summary * sum){
+  struct vclock min, max;
+  VCLOCK_FROM_NS(min, sum->min);
+  VCLOCK_FROM_NS(max, sum->max);
+  fprintf(output,"%s Time Range: %u:%u - %u:%u\n", name, min.sec, min.ns, max.sec, max.ns);
+}
+
+//Show the log2 histogram of a completed process stat
+static void output_hist(const char * name, const struct stats_summary * sum){
   int i;
-  for(i=0; i < C; ++i){ //for each process
-    if(childpids[i] == 0){  //if pid is zero, process doesn't exist
+  fprintf(output,"%s Time Histogram (ns):\n", name);
+  for(i=0; i < STATS_BUCKETS; i++){
+    if(sum->hist[i] == 0){
       continue;
     }
 
-    int status;
-    if(waitpid(childpids[i], &status, WNOHANG) > 0){
-
-      if (WIFEXITED(status)) {  //if process exited
+    if(i == 0){
+      fprintf(output,"  = 0    : %u\n", sum->hist[i]);
+    }else{
+      fprintf(output,"  < 2^%-2d : %u\n", i, sum->hist[i]);
+    }
+  }
+}
 
-        fprintf(output,"Master: Child %u terminated with %i at %u:%u\n",
-          childpids[i], WEXITSTATUS(status), shmp->vclk.sec, shmp->vclk.ns);
+//Show the confidence intervals of online estimates
+static void output_estimates(){
+  int i;
+  for(i=0; i < EST_COUNT; i++){
+    double half;
+    if(estimate_interval(&est[i], &half) < 0){
+      fprintf(output,"%s 95%% CI: too few samples (%lu)\n", estimate_names[i], (unsigned long) est[i].n);
+      continue;
+    }
 
-      }else if(WIFSIGNALED(status)){  //if process was signalled
-        fprintf(output,"Master: Child %u killed with signal %d at system time at %u:%u\n",
-          childpids[i], WTERMSIG(status), shmp->vclk.sec, shmp->vclk.ns);
-      }
-      childpids[i] = 0;
+    //interval is of the mean, stddev is of single samples
+    const double rel = (est[i].mean > 0.0) ? 100.0 * half / est[i].mean : 0.0;
+    const double sd = estimate_stddev(&est[i]);
+    if(i == EST_UTIL){
+      fprintf(output,"%s 95%% CI: %.3f +- %.3f (%.1f%%, %u batches of %lu windows), Std Dev %.3f\n",
+        estimate_names[i], est[i].mean, half, rel, est[i].nbatches, (unsigned long) est[i].batch_size, sd);
+    }else{
+      struct vclock mean, h, s;
+      VCLOCK_FROM_NS(mean, (uint64_t) est[i].mean);
+      VCLOCK_FROM_NS(h,    (uint64_t) half);
+      VCLOCK_FROM_NS(s,    (uint64_t) sd);
+      fprintf(output,"%s 95%% CI: %u:%u +- %u:%u (%.1f%%, %u batches of %lu jobs), Std Dev %u:%u\n",
+        estimate_names[i], mean.sec, mean.ns, h.sec, h.ns, rel, est[i].nbatches, (unsigned long) est[i].batch_size, s.sec, s.ns);
     }
   }
+
+  if(arg_e > 0.0){
+    fprintf(output,"Target Precision: %.1f%%, %s\n", 100.0 * arg_e,
+      (est_done) ? "reached" : "not reached");
+  }
+}
+
+//Show utilisation and queueing delay of IO devices
+static void output_devices(){
+  const uint64_t runtime = VCLOCK_NS(shmp->vclk);
+  unsigned int i;
+  for(i=0; arg_w && (i < wl.ndevices); i++){
+    const struct device * dev = &devices[i];
+
+    struct vclock ave, max;
+    VCLOCK_FROM_NS(ave, dev->wait_ns / ((dev->served) ? dev->served : 1));
+    VCLOCK_FROM_NS(max, dev->wait_max);
+    fprintf(output,"Device %s (%s): %u requests, Utilisation %.3f, Average Queueing Delay %u:%u, Max %u:%u, Max Queue %d\n",
+      dev->spec->name, (dev->spec->policy == DEVICE_FIFO) ? "fifo" : "elevator", dev->served,
+      (runtime) ? (double) dev->busy_ns / runtime : 0.0, ave.sec, ave.ns, max.sec, max.ns, dev->max_count);
+  }
 }
 
 static void output_result(){
 
-  VCLOCK_AVE(vclk_stat[TURN_TIME],  C);
-  VCLOCK_AVE(vclk_stat[WAIT_TIME],  C);
-  VCLOCK_AVE(vclk_stat[SLEEP_TIME], C);
+  struct stats_summary sum[STAT_COUNT];
+  struct vclock turn, wait, sleep;
+  int i;
+
+  for(i=0; i < STAT_COUNT; i++){
+    stats_summary(&st, i, &sum[i]);
+  }
+
+  const uint64_t n = (st.count) ? st.count : 1;
+  VCLOCK_FROM_NS(turn,  sum[STAT_SYSTEM].sum / n);
+  VCLOCK_FROM_NS(wait,  (sum[STAT_SYSTEM].sum - sum[STAT_CPU].sum) / n);  /* wait time = total_system time - total cpu time */
+  VCLOCK_FROM_NS(sleep, sum[STAT_BLOCKED].sum / n);
 
   fprintf(output,"Quantum: %d\n", QUANTUM_NS);
   fprintf(output,"Runtime: %u:%u\n", shmp->vclk.sec, shmp->vclk.ns);
-  fprintf(output,"Average Turnaround Time: %u:%u\n",  vclk_stat[TURN_TIME].sec,   vclk_stat[TURN_TIME].ns);
-  fprintf(output,"Average Wait Time. : %u:%u\n",      vclk_stat[WAIT_TIME].sec,   vclk_stat[WAIT_TIME].ns);
-  fprintf(output,"Average Blocked Time: %u:%u\n",     vclk_stat[SLEEP_TIME].sec,  vclk_stat[SLEEP_TIME].ns);
+  fprintf(output,"Completed: %u\n", st.count);
+  fprintf(output,"Average Turnaround Time: %u:%u\n",  turn.sec,   turn.ns);
+  fprintf(output,"Average Wait Time. : %u:%u\n",      wait.sec,   wait.ns);
+  fprintf(output,"Average Blocked Time: %u:%u\n",     sleep.sec,  sleep.ns);
   fprintf(output,"Idle Time: %u:%u\n",        vclk_stat[IDLE_TIME].sec,   vclk_stat[IDLE_TIME].ns);
 
-  //TODO: ave cpu util
+  if(arg_k){
+    struct vclock total;
+    VCLOCK_FROM_NS(total, dispatches*costs.ipc + switches*costs.cswitch + cold_starts*costs.cold);
+    fprintf(output,"Dispatch Overhead: %u:%u, %u dispatches of %lu ns, %u switches of %lu ns, %u cold caches of %lu ns\n",
+      total.sec, total.ns, dispatches, (unsigned long) costs.ipc, switches, (unsigned long) costs.cswitch,
+      cold_starts, (unsigned long) costs.cold);
+  }
+
+  if(arg_r){
+    struct vclock cpu, ready, disp;
+    VCLOCK_FROM_NS(cpu,   real_cpu_ns);
+    VCLOCK_FROM_NS(ready, real_ready_ns);
+    VCLOCK_FROM_NS(disp,  real_dispatch_ns);
+    //CPU users report against wall clock we saw, the rest is IPC and switching
+    fprintf(output,"Measured CPU Time: %u:%u in %u:%u wall clock, %.1f%%\n", cpu.sec, cpu.ns, ready.sec, ready.ns,
+      (real_ready_ns) ? (100.0 * real_cpu_ns) / real_ready_ns : 0.0);
+    fprintf(output,"Measured Dispatch Time: %u:%u\n", disp.sec, disp.ns);
+  }
+
+  //offered load against what was done
+  const double runtime = VCLOCK_NS(shmp->vclk) / 1000000000.0;
+  if(runtime > 0.0){
+    fprintf(output,"Arrivals: %u\n", arrivals);
+    fprintf(output,"Arrival Rate: %.3f jobs/s\n", arrivals / runtime);
+    fprintf(output,"Throughput: %.3f jobs/s\n", st.count / runtime);
+  }
+
+  struct vclock lat_ave, lat_max;
+  VCLOCK_FROM_NS(lat_ave, admit_latency_sum / ((admitted) ? admitted : 1));
+  VCLOCK_FROM_NS(lat_max, admit_latency_max);
+  fprintf(output,"Admission Policy: %s, queue of %d\n", admit_policy_names[arg_A], aq.size);
+  fprintf(output,"Admitted: %u, Dropped: %u, Shed: %u, Waiting: %d\n", admitted, dropped, shed, admitq_size(&aq));
+  fprintf(output,"Average Admission Latency: %u:%u\n", lat_ave.sec, lat_ave.ns);
+  fprintf(output,"Max Admission Latency: %u:%u\n", lat_max.sec, lat_max.ns);
+
+  const double pct[3] = {50.0, 95.0, 99.0};
+  for(i=0; i < 3; i++){
+    struct vclock p;
+    VCLOCK_FROM_NS(p, stats_percentile(&st, STAT_SYSTEM, pct[i]));
+    fprintf(output,"Turnaround Time p%.0f: %u:%u\n", pct[i], p.sec, p.ns);
+  }
+
+  output_estimates();
+  output_devices();
+
+  output_range("Turnaround", &sum[STAT_SYSTEM]);
+  output_range("Ready",      &sum[STAT_READY]);
+  output_range("Blocked",    &sum[STAT_BLOCKED]);
+  output_hist("Turnaround",  &sum[STAT_SYSTEM]);
+}
+
+//Size of the shared region, rounded to a huge page if needed
+static size_t shared_size(){
+  size_t size = sizeof(struct shared);
+  if(arg_H){
+    size = (size + HUGE_PAGE_SIZE - 1) & ~((size_t)HUGE_PAGE_SIZE - 1);
+  }
+  return size;
 }
 
+static void idle_end();
+
 //Called at end to cleanup all resources and exit
 static void master_exit(const int ret)
 {
+  //spare users, that were never admitted
+  arrival_stop();
+
+  //idle period we stopped in is still open
+  if(shmp){
+    idle_end();
+  }
+
   //tell all users to terminate
   int i;
-  for(i=0; i < C; i++){
-    if(childpids[i] <= 0){
+  for(i=0; shmp && (i < MAX_USERS); i++){
+    if(shmp->procs[i].pid <= 0){
       continue;
     }
-  	kill(childpids[i], SIGTERM);
+  	kill(shmp->procs[i].pid, SIGTERM);
   }
   master_waitall();
 
+  //wait until output thread has written everything and saved the stats
+  output_stop();
   output_result();
+  PROF_REPORT(output);
+  stats_free(&st);
+  feedbackq_free(fq);
+  blockedq_free(&bq);
+  pcbmap_free(&pm);
 
   if(shmp){
-    shmdt(shmp);
-    shmctl(shmid, IPC_RMID, NULL);
+    if(arg_p){
+      munmap(shmp, shared_size());
+      shm_unlink(shm_name);
+    }else{
+      shmdt(shmp);
+      shmctl(shmid, IPC_RMID, NULL);
+    }
   }
 
   if(msgid > 0){
     msgctl(msgid, IPC_RMID, NULL);
   }
 
+  trace_close();
+
   fclose(output);
 	exit(ret);
 }
@@ -198,43 +653,158 @@ static void master_exit(const int ret)
 static void vclock_increment(struct vclock * x, struct vclock * inc){
   x->sec += inc->sec;
   x->ns += inc->ns;
-	if(x->ns > 1000000000){
+	while(x->ns >= 1000000000){ //carry the rest of ns, not just the second
 		x->sec++;
-		x->ns = 0;
+		x->ns -= 1000000000;
 	}
 }
 
 static void vclock_substract(struct vclock * x, struct vclock * y, struct vclock * z){
   z->sec = x->sec - y->sec;
 
-  if(y->ns > x->ns){
-    z->ns = y->ns - x->ns;
+  if(y->ns > x->ns){ //borrow a second
+    z->ns = 1000000000 + x->ns - y->ns;
     z->sec--;
   }else{
     z->ns = x->ns - y->ns;
   }
 }
 
-//Move time forward
-static int update_timer(struct shared *shmp, struct vclock * fork_vclock)
+//CPU has no ready process, from now
+static void idle_begin(){
+  if(idling == 0){
+    master_log("[%u:%u] Master: No process ready to dispatch.\n", shmp->vclk.sec, shmp->vclk.ns);
+    VCLOCK_COPY(idle_vclock, shmp->vclk);
+    idling = 1;
+  }
+}
+
+//CPU got a ready process, count the time we were idle
+static void idle_end(){
+  if(idling == 0){
+    return;
+  }
+
+  struct vclock temp;
+  vclock_substract(&shmp->vclk, &idle_vclock, &temp);
+  master_log("[%u:%u] Master: End of idle mode of %u:%u.\n",
+    shmp->vclk.sec, shmp->vclk.ns, temp.sec, temp.ns);
+  vclock_increment(&vclk_stat[IDLE_TIME], &temp);
+  trace_slice(TRACE_IDLE, -1, 0, VCLOCK_NS(idle_vclock), VCLOCK_NS(shmp->vclk));
+
+  idle_vclock.sec  = 0;
+  idle_vclock.ns = 0;
+  idling = 0;
+}
+
+//Give arrival a pcb and create its process
+static void master_admit_one(struct process * pcb, const struct admission * a, const uint64_t admitted_ns)
 {
-  static const int maxTimeBetweenNewProcsSecs = 1;
-  static const int maxTimeBetweenNewProcsNS = 500000;
+  pcb->job_class = a->job_class;
+
+  //time from arrival to getting a pcb
+  const uint64_t latency = admitted_ns - VCLOCK_NS(a->arrived);
+  admit_latency_sum += latency;
+  if(latency > admit_latency_max){
+    admit_latency_max = latency;
+  }
+  admitted++;
+
+  const pid_t pid = master_fork("./user", pcb, (arg_P) ? user_take() : 0);
+  master_log("[%u:%u] Master: Creating new child pid %i\n", shmp->vclk.sec, shmp->vclk.ns, pid);
+
+  //turnaround starts at arrival, so it has the wait for admission
+  if(pid > 0){
+    PCB_VCLK(pcb)[FORK_TIME] = a->arrived;
+  }
+}
+
+//With block policy, arrivals wait while admission queue is full, and no pcb is free for them
+static int arrival_can_fork(){
+  return (arg_A != ADMIT_BLOCK) || !admitq_full(&aq) ||
+         ((admitq_size(&aq) == 0) && (pcbmap_avail(&pm) > 0));
+}
 
+//Handle a new arrival. It waits in admission queue, if there is no free pcb
+static void master_arrival(const struct vclock * arrived, const struct arrival * next)
+{
+  struct admission a;
+  a.arrived = *arrived;
+  a.job_class = next->job_class;
+
+  //nobody is waiting before us, try to get a pcb right away
+  if(admitq_size(&aq) == 0){
+    struct process *pcb = pcb_get();
+    if(pcb){
+      /* we see arrival only after the burst it came in. If a pcb was free before
+         that burst, arrival got it right away, else when burst released one */
+      const uint64_t arrived_ns = VCLOCK_NS(a.arrived);
+      if(pcb_idle > 0){
+        pcb_idle--;
+        master_admit_one(pcb, &a, arrived_ns);
+      }else{
+        master_admit_one(pcb, &a, (pcb_freed_ns > arrived_ns) ? pcb_freed_ns : arrived_ns);
+      }
+      return;
+    }
+  }
+
+  if(admitq_enq(&aq, &a) >= 0){
+    master_log("[%u:%u] Master: No pcb available, arrival waits for admission\n", shmp->vclk.sec, shmp->vclk.ns);
+    return;
+  }
+
+  if((arg_A == ADMIT_SHED) && (admitq_shed(&aq, &a) == 0)){
+    master_log("[%u:%u] Master: Admission queue full, shed arrival of lower class\n", shmp->vclk.sec, shmp->vclk.ns);
+    shed++;
+  }else{
+    master_log("[%u:%u] Master: Admission queue full, dropped arrival\n", shmp->vclk.sec, shmp->vclk.ns);
+    dropped++;
+  }
+}
+
+//Admit queued arrivals, while we have free pcbs
+static void master_admit()
+{
+  struct admission a;
+
+  while((C < arg_n) && (admitq_size(&aq) > 0)){
+
+    struct process *pcb = pcb_get();
+    if(pcb == NULL){
+      return; //no free processes, arrivals keep waiting
+    }
+
+    admitq_deq(&aq, &a);
+    master_admit_one(pcb, &a, VCLOCK_NS(shmp->vclk));
+  }
+}
+
+//Move time forward
+static void update_timer(struct shared *shmp)
+{
   struct vclock inc = {0, 100};
 
   vclock_increment(&shmp->vclk, &inc);
   usleep(10);
-  //fprintf(output, "[%u:%u] Master: Incremented system time with 100 ns\n", shmp->vclk.sec, shmp->vclk.ns);
+  //master_log("[%u:%u] Master: Incremented system time with 100 ns\n", shmp->vclk.sec, shmp->vclk.ns);
+}
 
+//Take next arrival if its time has come, arrived gets its time. Checked only if can_fork is set
+static int arrival_due(struct vclock * fork_vclock, const int can_fork, struct vclock * arrived, struct arrival * a)
+{
   //if its time to fork
-  if(  (shmp->vclk.sec  > fork_vclock->sec) ||
-      ((shmp->vclk.sec == fork_vclock->sec) && (shmp->vclk.ns > fork_vclock->ns))){
+  if(can_fork && (
+       (shmp->vclk.sec  > fork_vclock->sec) ||
+      ((shmp->vclk.sec == fork_vclock->sec) && (shmp->vclk.ns > fork_vclock->ns)))){
+
+    *arrived = *fork_vclock;
+    arrivals++;
+    arrival_next(a);
 
-    *fork_vclock = shmp->vclk;
-    inc.sec = (rand() % maxTimeBetweenNewProcsSecs);
-    inc.ns  = (rand() % maxTimeBetweenNewProcsNS);
-    vclock_increment(fork_vclock, &inc);
+    //with workload, arrivals are open loop - next one is from previous, not from current time
+    const uint64_t next = ((arg_w) ? VCLOCK_NS(*fork_vclock) : VCLOCK_NS(shmp->vclk)) + a->inc;
+    VCLOCK_FROM_NS((*fork_vclock), next);
 
     return 1;
   }
@@ -247,15 +817,30 @@ static int update_options(const int argc, char * const argv[])
 {
 
   int opt;
-	while((opt=getopt(argc, argv, "hc:l:t:")) != -1){
+  char * end;
+  long size;
+	while((opt=getopt(argc, argv, "hc:l:t:pHraT:w:A:B:Pn:e:C:k:")) != -1){
 		switch(opt){
 			case 'h':
-				fprintf(output,"Usage: master [-h]\n");
-        fprintf(output,"Usage: master [-n x] [-s x] [-t time] infile\n");
-				fprintf(output," -h Describe program options\n");
-				fprintf(output," -c x Total of child processes (Default is 5)\n");
-        fprintf(output," -l filename Log filename (Default is log.txt)\n");
-        fprintf(output," -t x Maximum runtime (Default is 20)\n");
+				printf("Usage: master [-h]\n");
+        printf("Usage: master [-n x] [-s x] [-t time] infile\n");
+				printf(" -h Describe program options\n");
+				printf(" -c x Total of child processes (Default is 5)\n");
+        printf(" -l filename Log filename (Default is log.txt)\n");
+        printf(" -t x Maximum runtime (Default is 20)\n");
+        printf(" -p Use POSIX shared memory with cache line aligned layout\n");
+        printf(" -H Use huge pages for shared memory, hugetlb or with -p transparent ones\n");
+        printf(" -r Real mode, users burn CPU and are preempted by a timer\n");
+        printf(" -a Pin users to CPUs, round robin\n");
+        printf(" -T filename Save timeline in Chrome trace format\n");
+        printf(" -w filename Workload with arrival and job class distributions\n");
+        printf(" -A policy When admission queue is full - drop, block or shed (Default is drop)\n");
+        printf(" -B x Arrivals that can wait for a pcb, 0 to %d (Default is %d)\n", ADMITQ_MAX, ADMITQ_DEFAULT);
+        printf(" -P Pipeline mode, arrivals and output run in their own threads\n");
+        printf(" -n x Maximum children to create (Default is %d, or %d with -e)\n", MAX_CHILDREN, MAX_CHILDREN_ESTIMATE);
+        printf(" -e x Stop when 95%% confidence intervals are within x %% of the mean\n");
+        printf(" -C filename Measure IPC, context switch and cold cache costs of this host, and save them\n");
+        printf(" -k filename Add costs from a profile saved with -C to each dispatch\n");
 				return 1;
 
       case 'c':
@@ -270,8 +855,74 @@ static int update_options(const int argc, char * const argv[])
 				arg_l = strdup(optarg);
 				break;
 
+      case 'r':
+        arg_r = 1;
+        break;
+
+      case 'a':
+        arg_a = 1;
+        break;
+
+      case 'T':
+        arg_T = strdup(optarg);
+        break;
+
+      case 'w':
+        arg_w = strdup(optarg);
+        break;
+
+      case 'A':
+        if(strcmp(optarg, "drop") == 0){
+          arg_A = ADMIT_DROP;
+        }else if(strcmp(optarg, "block") == 0){
+          arg_A = ADMIT_BLOCK;
+        }else if(strcmp(optarg, "shed") == 0){
+          arg_A = ADMIT_SHED;
+        }else{
+          fprintf(stderr, "Error: Invalid admission policy '%s'\n", optarg);
+          return -1;
+        }
+        break;
+
+      case 'B':
+        size = strtol(optarg, &end, 10);
+        if((end == optarg) || (*end != '\0') || (size < 0) || (size > ADMITQ_MAX)){
+          fprintf(stderr, "Error: Invalid admission queue size '%s', must be 0 to %d\n", optarg, ADMITQ_MAX);
+          return -1;
+        }
+        arg_B = size;
+        break;
+
+      case 'P':
+        arg_P = 1;
+        break;
+
+      case 'n':
+        arg_n = atoi(optarg);
+        break;
+
+      case 'e':
+        arg_e = atof(optarg) / 100.0;
+        break;
+
+      case 'C':
+        arg_C = strdup(optarg);
+        break;
+
+      case 'k':
+        arg_k = strdup(optarg);
+        break;
+
+      case 'H':
+        arg_H = 1;
+        break;
+
+      case 'p':
+        arg_p = 1;
+        break;
+
 			default:
-				fprintf(output, "Error: Invalid option '%c'\n", opt);
+				fprintf(stderr, "Error: Invalid option '%c'\n", opt);
 				return -1;
 		}
 	}
@@ -279,43 +930,237 @@ static int update_options(const int argc, char * const argv[])
 	if(arg_l == NULL){
 		arg_l = strdup("log.txt");
 	}
+
+  if(arg_n == 0){
+    arg_n = (arg_e > 0.0) ? MAX_CHILDREN_ESTIMATE : MAX_CHILDREN;
+  }
   return 0;
 }
 
-//Initialize the shared memory
-static int shared_initialize()
+//Create the shared region with shm_open and mmap
+static int shared_posix_initialize()
 {
-  key_t key = ftok(FTOK_SHM_PATH, FTOK_SHM_KEY);  //get a key for the shared memory
-	if(key == -1){
-		perror("ftok");
-		return -1;
-	}
+  snprintf(shm_name, SHM_NAME_LEN, SHM_NAME_FMT, getpid());
+
+  const int fd = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, S_IRWXU);
+  if(fd == -1){
+    perror("shm_open");
+    return -1;
+  }
 
-  const long shared_size = sizeof(struct shared);
+  if(ftruncate(fd, shared_size()) == -1){
+    perror("ftruncate");
+    close(fd);
+    return -1;
+  }
+
+  void * addr = mmap(NULL, shared_size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(addr == MAP_FAILED){
+    perror("mmap");
+    return -1;
+  }
+
+  /* shm objects live on tmpfs, where MAP_HUGETLB is refused, so ask for transparent huge pages.
+     Kernel ignores this when shmem_enabled is never, shared_huge_check tells if we got them */
+  if(arg_H && (madvise(addr, shared_size(), MADV_HUGEPAGE) == -1)){
+    perror("madvise");
+  }
+
+  shmp = (struct shared*) addr;
+  return 0;
+}
+
+//Create the shared region with shmget and shmat
+static int shared_sysv_initialize()
+{
+  //hugetlb pages are reserved by admin in vm.nr_hugepages, use normal pages if there are none
+  shmid = -1;
+  if(arg_H){
+    shmid = shmget(IPC_PRIVATE, shared_size(), SHM_HUGETLB | S_IRWXU);
+    if(shmid == -1){
+      fprintf(output, "Master: shmget with SHM_HUGETLB failed (%s), using normal pages\n", strerror(errno));
+    }
+  }
 
-	shmid = shmget(key, shared_size, IPC_CREAT | IPC_EXCL | S_IRWXU);
+	if(shmid == -1){
+	  shmid = shmget(IPC_PRIVATE, shared_size(), S_IRWXU);
+  }
 	if(shmid == -1){
 		perror("shmget");
 		return -1;
 	}
 
   shmp = (struct shared*) shmat(shmid, NULL, 0); //attach it
-  if(shmp == NULL){
+  if(shmp == (void*) -1){
 		perror("shmat");
+    shmp = NULL;
 		return -1;
 	}
 
-	key = ftok(FTOK_Q_PATH, FTOK_Q_KEY);
-	if(key == -1){
-		perror("ftok");
-		return -1;
-	}
+  /* Linux lets users attach a removed segment by id, while we are attached.
+     It is freed when last process detaches, so a crash can't leave it behind */
+  shmctl(shmid, IPC_RMID, NULL);
+  snprintf(shmid_arg, sizeof(shmid_arg), "%d", shmid);
+  return 0;
+}
+
+//Check if process is a zombie, waiting to be reaped
+static int pid_zombie(const pid_t pid){
+  char path[32], state = 0;
+  snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+
+  FILE * fp = fopen(path, "r");
+  if(fp == NULL){
+    return 0;
+  }
+  const int rv = fscanf(fp, "%*d (%*[^)]) %c", &state);
+  fclose(fp);
+
+  return (rv == 1) && (state == 'Z');
+}
+
+//Check if IPC object of master with pid is left over
+static int ipc_orphaned(const pid_t pid){
+  //our own pid means a master with the same pid crashed before us
+  if(pid == getpid()){
+    return 1;
+  }
+  return ((kill(pid, 0) == -1) && (errno == ESRCH)) || pid_zombie(pid);
+}
+
+//Remove POSIX shared memory of crashed masters
+static void ipc_cleanup_posix(){
+
+  DIR * dir = opendir("/dev/shm");
+  if(dir == NULL){
+    return;
+  }
+
+  struct dirent * ent;
+  while((ent = readdir(dir)) != NULL){
+    if(strncmp(ent->d_name, SHM_NAME_PREFIX, strlen(SHM_NAME_PREFIX)) != 0){
+      continue;
+    }
+
+    //only objects named by us, with a pid, and made by our user
+    const char * pid_str = &ent->d_name[strlen(SHM_NAME_PREFIX)];
+    struct stat sb;
+    if( (strspn(pid_str, "0123456789") != strlen(pid_str)) ||
+        (fstatat(dirfd(dir), ent->d_name, &sb, AT_SYMLINK_NOFOLLOW) == -1) ||
+        (sb.st_uid != geteuid())){
+      continue;
+    }
 
-	msgid = msgget(key, IPC_CREAT | IPC_EXCL | 0666);
+    const pid_t pid = atoi(pid_str);
+    if((pid > 0) && ipc_orphaned(pid)){
+      char name[SHM_NAME_LEN];
+      snprintf(name, SHM_NAME_LEN, SHM_NAME_FMT, pid);
+      if(shm_unlink(name) == 0){
+        fprintf(output,"Master: Removed orphaned shared memory %s of master %d\n", name, pid);
+      }
+    }
+  }
+  closedir(dir);
+}
+
+//Remove message queues of crashed masters. They are private, so only
+//queues of our user, whose last sender and receiver are both gone
+static void ipc_cleanup_msg(){
+  char line[256];
+  int key, id;
+  unsigned long cbytes, qnum;
+  unsigned int perms, uid;
+  pid_t lspid, lrpid;
+
+  FILE * fp = fopen("/proc/sysvipc/msg", "r");
+  if(fp == NULL){
+    return;
+  }
+
+  fgets(line, sizeof(line), fp); //skip the header
+  while(fgets(line, sizeof(line), fp)){
+    if(sscanf(line, "%d %d %o %lu %lu %d %d %u",
+          &key, &id, &perms, &cbytes, &qnum, &lspid, &lrpid, &uid) != 8){
+      continue;
+    }
+
+    //a queue never used has no pids, and we can't tell whose it is
+    if( (key != IPC_PRIVATE) || (uid != geteuid()) ||
+        (lspid <= 0) || (lrpid <= 0)){
+      continue;
+    }
+
+    if(ipc_orphaned(lspid) && ipc_orphaned(lrpid) &&
+       (msgctl(id, IPC_RMID, NULL) == 0)){
+      fprintf(output,"Master: Removed orphaned message queue %d\n", id);
+    }
+  }
+  fclose(fp);
+}
+
+//Size of huge pages backing the mapping at addr, in kB
+static unsigned long shared_huge_kb(const void * addr){
+  char line[256];
+  unsigned long start, end, kb, total = 0;
+  int found = 0;
+
+  FILE * fp = fopen("/proc/self/smaps", "r");
+  if(fp == NULL){
+    return 0;
+  }
+
+  while(fgets(line, sizeof(line), fp)){
+    if(sscanf(line, "%lx-%lx ", &start, &end) == 2){ //header of next mapping
+      if(found){
+        break;
+      }
+      found = (start == (unsigned long) addr);
+    }else if(found &&
+            ((sscanf(line, "ShmemPmdMapped: %lu kB", &kb) == 1) ||
+             (sscanf(line, "Shared_Hugetlb: %lu kB", &kb) == 1) ||
+             (sscanf(line, "Private_Hugetlb: %lu kB", &kb) == 1))){
+      total += kb;
+    }
+  }
+  fclose(fp);
+  return total;
+}
+
+//Tell if -H got us huge pages, pages are faulted in first
+static void shared_huge_check(){
+  memset(shmp, 0, shared_size());
+
+  const unsigned long kb = shared_huge_kb(shmp);
+  if(kb > 0){
+    fprintf(output, "Master: Shared memory uses %lu kB of huge pages\n", kb);
+  }else{
+    fprintf(output, "Master: Warning: No huge pages for shared memory. Check vm.nr_hugepages, or shmem_enabled in /sys/kernel/mm/transparent_hugepage with -p\n");
+  }
+}
+
+//Initialize the shared memory
+static int shared_initialize()
+{
+  //clear whatever crashed runs left behind. System V memory is removed at attach, queues are not
+  ipc_cleanup_posix();
+  ipc_cleanup_msg();
+
+  const int rv = (arg_p) ? shared_posix_initialize() : shared_sysv_initialize();
+  if(rv < 0){
+    return -1;
+  }
+
+  if(arg_H){
+    shared_huge_check();
+  }
+
+	msgid = msgget(IPC_PRIVATE, S_IRUSR | S_IWUSR);
 	if(msgid == -1){
 		perror("msgget");
 		return -1;
 	}
+  snprintf(msgid_arg, sizeof(msgid_arg), "%d", msgid);
   return 0;
 }
 
@@ -327,9 +1172,6 @@ static int master_initialize()
     return -1;
   }
 
-  //zero pids
-  bzero(childpids, sizeof(pid_t)*MAX_CHILDREN);
-
   //zero the shared clock
   shmp->vclk.sec	= 0;
 	shmp->vclk.ns	= 0;
@@ -337,15 +1179,84 @@ static int master_initialize()
   //zero the processes
   bzero(shmp, sizeof(struct shared));
 
+  if(arg_T && (trace_open(arg_T) < 0)){
+    return -1;
+  }
+
+  if(arg_k && (cost_load(&costs, arg_k) < 0)){
+    return -1;
+  }
+
+  if(arg_w){
+    if(workload_load(&wl, arg_w) < 0){
+      return -1;
+    }
+
+    //fixed seed, so runs with same workload can be compared
+    wl.seed[0] = 0x330E;
+    wl.seed[1] = 0xABCD;
+    wl.seed[2] = 0x1234;
+
+    //users read their class from shared memory
+    shmp->nclasses = wl.nclasses;
+    memcpy(shmp->classes, wl.classes, sizeof(struct job_class)*wl.nclasses);
+
+    unsigned int i;
+    for(i=0; i < wl.ndevices; i++){
+      device_init(&devices[i], &wl.devices[i]);
+    }
+  }
+
   //initialize queues
-  blockedq_init(&bq);
-  feedbackq_init(fq);
+  admitq_init(&aq, arg_B);
+  if( (pcbmap_init(&pm, MAX_USERS) < 0) ||
+      (blockedq_init(&bq, MAX_USERS) < 0) ||
+      (feedbackq_init(fq, MAX_USERS) < 0)){
+    perror("malloc");
+    return -1;
+  }
+
+  int i;
+  for(i=0; i < EST_COUNT; i++){
+    estimate_init(&est[i]);
+  }
+
+  if(stats_init(&st, MAX_CHILDREN) < 0){
+    perror("malloc");
+    return -1;
+  }
+
+  //output thread starts first, so it sees everything we log
+  if(arg_P && ((output_start(output, &st) < 0) || (arrival_start() < 0))){
+    return -1;
+  }
+
+  if(arg_r){
+    //no SA_RESTART, so msgrcv is interrupted when quantum expires
+    struct sigaction sa;
+    bzero(&sa, sizeof(struct sigaction));
+    sa.sa_handler = quantum_handler;
+    sigemptyset(&sa.sa_mask);
+    if(sigaction(SIGUSR1, &sa, NULL) == -1){
+      perror("sigaction");
+      return -1;
+    }
+
+    struct sigevent sev;
+    bzero(&sev, sizeof(struct sigevent));
+    sev.sigev_notify = SIGEV_SIGNAL;
+    sev.sigev_signo = SIGUSR1;
+    if(timer_create(CLOCK_MONOTONIC, &sev, &quantum_timer) == -1){
+      perror("timer_create");
+      return -1;
+    }
+  }
 
   return 0;
 }
 
 //Send a message to user process. Buffer must be filled!
-static int send_msg(struct msgbuf *m)
+static int send_msg(struct message *m)
 {
 	m->from = getpid();	//mark who is sending the message
 	if(msgsnd(msgid, m, MSG_SIZE, 0) == -1){
@@ -355,44 +1266,149 @@ static int send_msg(struct msgbuf *m)
   return 0;
 }
 
-static int get_msg(struct msgbuf *m)
+static int get_msg(struct message *m)
 {
-	if(msgrcv(msgid, (void*)m, MSG_SIZE, getpid(), 0) == -1){
+	while(msgrcv(msgid, (void*)m, MSG_SIZE, getpid(), 0) == -1){
+    if((errno == EINTR) && quantum_expired){ //quantum timer went off
+      quantum_expired = 0;
+      continue;
+    }
 		perror("msgrcv");
 		return -1;
 	}
 	return 0;
 }
 
+//Arm or disarm the quantum timer, in real mode. Time that was left goes in old, if given
+static int quantum_timer_set(const unsigned int ns, struct itimerspec * old){
+  struct itimerspec its;
+  bzero(&its, sizeof(struct itimerspec));
+  its.it_value.tv_sec  = ns / 1000000000;
+  its.it_value.tv_nsec = ns % 1000000000;
+
+  if(timer_settime(quantum_timer, 0, &its, old) == -1){
+    perror("timer_settime");
+    return -1;
+  }
+  return 0;
+}
+
+//Run process with real quantum and measure how long it took
+static int dispatch_real(struct process * pcb, struct message *mb){
+
+  struct timespec t0, t1;
+
+  pcb->preempt = 0;
+  running = pcb;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  const int rv = (quantum_timer_set(mb->quant_ns, NULL) == -1) || (send_msg(mb) == -1) || (get_msg(mb) == -1);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  //stop the timer before we look at the reply, so a late expiry can't mark a process that stopped on its own
+  struct itimerspec left;
+  running = NULL;
+  if((quantum_timer_set(0, &left) == -1) || rv){
+    quantum_expired = 0;
+    return -1;
+  }
+  //expiry signal was handled when timer_settime returned, nothing is pending
+  pcb->preempt = (left.it_value.tv_sec == 0) && (left.it_value.tv_nsec == 0);
+  quantum_expired = 0;
+
+  const uint64_t real_ns = (t1.tv_sec - t0.tv_sec)*1000000000ULL + (t1.tv_nsec - t0.tv_nsec);
+  if(mb->msg == READY){
+    master_log("[%u:%u] Master: Process with PID %u measured %u ns CPU in %lu ns real time\n",
+      shmp->vclk.sec, shmp->vclk.ns, pcb->id, mb->quant_ns, (unsigned long) real_ns);
+    real_cpu_ns += mb->quant_ns;
+    real_ready_ns += real_ns;
+  }
+  real_dispatch_ns += real_ns;
+
+  return 0;
+}
+
+//Device process does IO on, or NULL if it blocks for fixed time
+static struct device * pcb_device(const struct process * pcb){
+  if((arg_w == NULL) || (wl.classes[pcb->job_class].device < 0)){
+    return NULL;
+  }
+  return &devices[wl.classes[pcb->job_class].device];
+}
+
+//If device is idle, start its next request at now. Process is blocked until request is done
+static void device_next(struct device * dev, const uint64_t now){
+
+  struct device_request r;
+  uint64_t finish;
+  if(device_start(dev, now, &r, &finish) < 0){
+    return;
+  }
+
+  //burst time has time process is blocked, with queueing delay
+  struct process * pcb = &shmp->procs[r.p];
+  VCLOCK_FROM_NS(PCB_VCLK(pcb)[BLOCKED_TIME], finish);
+  VCLOCK_FROM_NS(PCB_VCLK(pcb)[BURST_TIME], finish - r.requested);
+  blockedq_enq(&bq, r.p, finish);
+
+  master_log("[%u:%u] Master: Device %d started IO of process with PID %u, done at %u:%u\n",
+    shmp->vclk.sec, shmp->vclk.ns, (int)(dev - devices), pcb->id, PCB_VCLK(pcb)[BLOCKED_TIME].sec, PCB_VCLK(pcb)[BLOCKED_TIME].ns);
+}
+
+//Queue IO request of process on its device
+static void device_io(struct device * dev, const int pcb_index){
+
+  struct device_request r;
+  r.p = pcb_index;
+  r.track = nrand48(device_seed) % dev->spec->tracks;
+  r.requested = VCLOCK_NS(shmp->vclk);
+  r.service = dist_sample(&dev->spec->service, device_seed);
+
+  if(device_submit(dev, &r) < 0){
+    fprintf(stderr, "[%i: %i] Error: Queueing IO of process with PID %d failed\n", shmp->vclk.sec, shmp->vclk.ns, shmp->procs[pcb_index].pid);
+    return;
+  }
+  master_log("[%u:%u] Master: Process with PID %u queued IO on device %d, %d requests waiting\n",
+    shmp->vclk.sec, shmp->vclk.ns, shmp->procs[pcb_index].id, (int)(dev - devices), device_size(dev));
+
+  device_next(dev, r.requested);
+}
+
 static int update_pcb_state(struct process * pcb, const int q){
 
   switch(pcb->state){
     case READY:
-      fprintf(output,"[%u:%u] Master: Receiving that process with PID %u ran for %u nanoseconds\n",
-        shmp->vclk.sec, shmp->vclk.ns, pcb->id, pcb->vclk[BURST_TIME].ns);
+      master_log("[%u:%u] Master: Receiving that process with PID %u ran for %u nanoseconds\n",
+        shmp->vclk.sec, shmp->vclk.ns, pcb->id, PCB_VCLK(pcb)[BURST_TIME].ns);
 
-      vclock_increment(&pcb->vclk[TOTAL_CPU], &pcb->vclk[BURST_TIME]);
+      vclock_increment(&PCB_VCLK(pcb)[TOTAL_CPU], &PCB_VCLK(pcb)[BURST_TIME]);
       //update shared clock with burst time
-      vclock_increment(&shmp->vclk,          &pcb->vclk[BURST_TIME]);
+      vclock_increment(&shmp->vclk,          &PCB_VCLK(pcb)[BURST_TIME]);
+      busy_ns += VCLOCK_NS(PCB_VCLK(pcb)[BURST_TIME]);
       break;
 
     case IOBLK:
-      fprintf(output,"[%u:%u] Master: Process with PID %u has blocked on IO to %u:%u\n",
-          shmp->vclk.sec, shmp->vclk.ns, pcb->id, pcb->vclk[BURST_TIME].sec, pcb->vclk[BURST_TIME].ns);
+      if(pcb_device(pcb)){  //blocked time is known when device serves the request
+        break;
+      }
+      master_log("[%u:%u] Master: Process with PID %u has blocked on IO to %u:%u\n",
+          shmp->vclk.sec, shmp->vclk.ns, pcb->id, PCB_VCLK(pcb)[BURST_TIME].sec, PCB_VCLK(pcb)[BURST_TIME].ns);
       /* add burst and current timer to make blocked timestamp */
-  		vclock_increment(&pcb->vclk[BLOCKED_TIME], &pcb->vclk[BURST_TIME]);
-  		vclock_increment(&pcb->vclk[BLOCKED_TIME], &shmp->vclk);
+  		vclock_increment(&PCB_VCLK(pcb)[BLOCKED_TIME], &PCB_VCLK(pcb)[BURST_TIME]);
+  		vclock_increment(&PCB_VCLK(pcb)[BLOCKED_TIME], &shmp->vclk);
       break;
 
     case TERMINATE:
 
-      vclock_increment(&pcb->vclk[TOTAL_CPU], &pcb->vclk[BURST_TIME]);
-      vclock_substract(&shmp->vclk, &pcb->vclk[FORK_TIME], &pcb->vclk[TOTAL_SYSTEM]);
-      fprintf(output,"[%u:%u] Master: Process with PID %u terminated\n", shmp->vclk.sec, shmp->vclk.ns, pcb->id);
+      vclock_increment(&PCB_VCLK(pcb)[TOTAL_CPU], &PCB_VCLK(pcb)[BURST_TIME]);
+      vclock_increment(&shmp->vclk,          &PCB_VCLK(pcb)[BURST_TIME]);
+      busy_ns += VCLOCK_NS(PCB_VCLK(pcb)[BURST_TIME]);
+      vclock_substract(&shmp->vclk, &PCB_VCLK(pcb)[FORK_TIME], &PCB_VCLK(pcb)[TOTAL_SYSTEM]);
+      master_log("[%u:%u] Master: Process with PID %u terminated\n", shmp->vclk.sec, shmp->vclk.ns, pcb->id);
       break;
 
     default:
-      fprintf(output,"[%u:%u] Master: Process with PID %d has invalid state\n", shmp->vclk.sec, shmp->vclk.ns, pcb->pid);
+      master_log("[%u:%u] Master: Process with PID %d has invalid state\n", shmp->vclk.sec, shmp->vclk.ns, pcb->pid);
       return -1;
       break;
   }
@@ -401,76 +1417,130 @@ static int update_pcb_state(struct process * pcb, const int q){
 
 static void update_queue(struct process * pcb, int q){
 
-  const int pcb_index = feedbackq_deq(&fq[q], 0);
-  struct vclock res;
+  const int pcb_index = feedbackq_deq(&fq[q]);
 
   switch(pcb->state){
     case TERMINATE:
 
-      //vclk_stat[TURN_TIME] time = system time / num processes
-      vclock_increment(&vclk_stat[TURN_TIME], &pcb->vclk[TOTAL_SYSTEM]);
+      //save process record, stats are aggregated at exit
+      if(arg_P){
+        output_stats(pcb->pid, &shmp->times[pcb - shmp->procs]);
+      }else if(stats_append(&st, &shmp->times[pcb - shmp->procs]) < 0){
+        fprintf(stderr, "[%i: %i] Error: Saving stats of process with PID %d failed\n", shmp->vclk.sec, shmp->vclk.ns, pcb->pid);
+      }
 
-      /* wait time = total_system time - total cpu time */
-      vclock_substract(&pcb->vclk[TOTAL_SYSTEM], &pcb->vclk[TOTAL_CPU], &res);
-      vclock_increment(&vclk_stat[WAIT_TIME], &res);
+      //wait time is what process spent not running
+      const uint64_t system = VCLOCK_NS(PCB_VCLK(pcb)[TOTAL_SYSTEM]);
+      const uint64_t cpu    = VCLOCK_NS(PCB_VCLK(pcb)[TOTAL_CPU]);
+      estimate_add(&est[EST_TURNAROUND], system);
+      estimate_add(&est[EST_WAIT], (system > cpu) ? system - cpu : 0);
+      est_updated = 1;
 
-      fprintf(output,"[%u:%u] Master: Process with PID %u terminated, removed from queue %d\n", shmp->vclk.sec, shmp->vclk.ns, pcb->id, q);
+      master_log("[%u:%u] Master: Process with PID %u terminated, removed from queue %d\n", shmp->vclk.sec, shmp->vclk.ns, pcb->id, q);
       pcb_release(shmp->procs, pcb_index);
+      master_waitall();  //reap users that already exited
       break;
 
     case IOBLK:
-      fprintf(output,"[%u:%u] Master: Putting process with PID %u into blocked queue\n", shmp->vclk.sec, shmp->vclk.ns, pcb->id);
-      blockedq_enq(&bq, pcb_index);
+      if(pcb_device(pcb)){
+        device_io(pcb_device(pcb), pcb_index);
+        break;
+      }
+      master_log("[%u:%u] Master: Putting process with PID %u into blocked queue\n", shmp->vclk.sec, shmp->vclk.ns, pcb->id);
+      blockedq_enq(&bq, pcb_index, VCLOCK_NS(PCB_VCLK(pcb)[BLOCKED_TIME]));
       break;
 
     default:
       //check if process was preepted
-      if(pcb->vclk[BURST_TIME].ns == feedbackq_quant(&fq[q])){
+      if(pcb->preempt || (PCB_VCLK(pcb)[BURST_TIME].ns >= feedbackq_quant(&fq[q]))){
         //if we can move process to next level queue
         if(q < (FEEDBACK_LEVELS - 1)){
           q++;
         }
       }else{
-        fprintf(output,"[%u:%u] Master: not using its entire time quantum\n", shmp->vclk.sec, shmp->vclk.ns);
+        master_log("[%u:%u] Master: not using its entire time quantum\n", shmp->vclk.sec, shmp->vclk.ns);
       }
-      VCLOCK_COPY(pcb->vclk[READY_TIME], shmp->vclk);
+      VCLOCK_COPY(PCB_VCLK(pcb)[READY_TIME], shmp->vclk);
 
-      fprintf(output,"[%u:%u] Master: Process with PID %u moved to queue %d\n", shmp->vclk.sec, shmp->vclk.ns, pcb->id, q);
+      master_log("[%u:%u] Master: Process with PID %u moved to queue %d\n", shmp->vclk.sec, shmp->vclk.ns, pcb->id, q);
       feedbackq_enq(&fq[q], pcb_index);
       break;
   }
 }
 
+//Time master spends on a dispatch. Without a cost profile, it is random
+static unsigned int dispatch_cost(const struct process * pcb, const int pcb_index){
+
+  if(arg_k == NULL){
+    return rand() % 100;
+  }
+
+  //message to user and back
+  uint64_t ns = costs.ipc;
+  dispatches++;
+
+  if(pcb->id != last_id){
+    ns += costs.cswitch;
+    switches++;
+    last_id = pcb->id;
+
+    //others ran while it was blocked, so its working set is gone. There is one CPU, no migrations
+    if(pcb_cold[pcb_index]){
+      ns += costs.cold;
+      cold_starts++;
+    }
+  }
+  pcb_cold[pcb_index] = 0;
+  return ns;
+}
+
 static int dispatch_fq(const int q){
 
   const int pcb_index = feedbackq_top(&fq[q]);
   struct process * pcb = &shmp->procs[pcb_index];
+  const unsigned int overhead = dispatch_cost(pcb, pcb_index);
 
-  fprintf(output,"[%u:%u] Master: Dispatching process with PID %u from queue %i\n", shmp->vclk.sec, shmp->vclk.ns, pcb->id, q);
+  master_log("[%u:%u] Master: Dispatching process with PID %u from queue %i\n", shmp->vclk.sec, shmp->vclk.ns, pcb->id, q);
 
-  struct msgbuf mb;
+  //time process waited in queue
+  const uint64_t start = VCLOCK_NS(shmp->vclk);
+  trace_slice(TRACE_READY, pcb->id, q, VCLOCK_NS(PCB_VCLK(pcb)[READY_TIME]), start);
+
+  struct message mb;
   mb.mtype = pcb->pid;
   mb.quant_ns = feedbackq_quant(&fq[q]);
 
   //tell process he can run and get his decision
-  if( (send_msg(&mb) == -1) || (get_msg(&mb) == -1) ){
+  PROF_BEGIN(PROF_IPC);
+  const int rv = (arg_r) ? dispatch_real(pcb, &mb) : ((send_msg(&mb) == -1) || (get_msg(&mb) == -1)) ? -1 : 0;
+  PROF_END(PROF_IPC);
+  if(rv == -1){
     return -1;
   }
 
   //set burst time - for execution or io
-  pcb->vclk[BURST_TIME].sec = mb.quant_s;
-  pcb->vclk[BURST_TIME].ns = mb.quant_ns;
+  PCB_VCLK(pcb)[BURST_TIME].sec = mb.quant_s;
+  PCB_VCLK(pcb)[BURST_TIME].ns = mb.quant_ns;
 
   pcb->state = mb.msg;
 
+  PROF_BEGIN(PROF_UPDATE_PCB);
   update_pcb_state(pcb, q);
+  PROF_END(PROF_UPDATE_PCB);
+
+  if(pcb->state != IOBLK){
+    trace_slice(TRACE_RUNNING, pcb->id, q, start, start + VCLOCK_NS(PCB_VCLK(pcb)[BURST_TIME]));
+  }
+
+  PROF_BEGIN(PROF_UPDATE_QUEUE);
   update_queue(pcb, q);
+  PROF_END(PROF_UPDATE_QUEUE);
 
   //calculate dispatch time
   struct vclock temp;
   temp.sec = 0;
-  temp.ns = rand() % 100;
-  fprintf(output,"[%u:%u] Master: total time this dispatching was %d nanoseconds\n", shmp->vclk.sec, shmp->vclk.ns, temp.ns);
+  temp.ns = overhead;
+  master_log("[%u:%u] Master: total time this dispatching was %d nanoseconds\n", shmp->vclk.sec, shmp->vclk.ns, temp.ns);
   vclock_increment(&shmp->vclk, &temp);
 
   return 0;
@@ -478,37 +1548,77 @@ static int dispatch_fq(const int q){
 
 static int dispatch_bq(){
 
-  const int pcb_index = blockedq_ready(&bq, &shmp->vclk, shmp->procs);
+  const int pcb_index = blockedq_ready(&bq, VCLOCK_NS(shmp->vclk));
   if(pcb_index == -1){
     return -1;
   }
   struct process * pcb = &shmp->procs[pcb_index];
 
   //burst time of pcb has time process was blocked
-  vclock_increment(&vclk_stat[SLEEP_TIME], &pcb->vclk[BURST_TIME]);
+  vclock_increment(&PCB_VCLK(pcb)[TOTAL_BLOCKED], &PCB_VCLK(pcb)[BURST_TIME]);
+  trace_slice(TRACE_BLOCKED, pcb->id, 0, VCLOCK_NS(PCB_VCLK(pcb)[BLOCKED_TIME]) - VCLOCK_NS(PCB_VCLK(pcb)[BURST_TIME]), VCLOCK_NS(shmp->vclk));
+
+  //device is free since the request finished, it can start the next one
+  struct device * dev = pcb_device(pcb);
+  if(dev && (dev->busy == pcb_index)){
+    device_done(dev);
+    device_next(dev, VCLOCK_NS(PCB_VCLK(pcb)[BLOCKED_TIME]));
+  }
 
   //change process pcb to ready, and reset timers
   pcb->state = READY;
-  pcb->vclk[BLOCKED_TIME].sec = pcb->vclk[BLOCKED_TIME].ns = 0;
-  pcb->vclk[BURST_TIME].sec = pcb->vclk[BURST_TIME].ns = 0;
-  pcb->vclk[READY_TIME] = shmp->vclk;
+  pcb_cold[pcb_index] = 1;
+  PCB_VCLK(pcb)[BLOCKED_TIME].sec = PCB_VCLK(pcb)[BLOCKED_TIME].ns = 0;
+  PCB_VCLK(pcb)[BURST_TIME].sec = PCB_VCLK(pcb)[BURST_TIME].ns = 0;
+  PCB_VCLK(pcb)[READY_TIME] = shmp->vclk;
 
   //add to first queue after unblock
   const int rv = feedbackq_enq(&fq[0], pcb_index);
   if(rv < 0){
     fprintf(stderr, "[%i: %i] Error: Queueing process with PID %d failed\n", shmp->vclk.sec, shmp->vclk.ns, pcb->pid);
   }else{
-    fprintf(output,"[%u:%u] Master: Unblocked process with PID %d to queue 0\n", shmp->vclk.sec, shmp->vclk.ns, pcb->id);
+    master_log("[%u:%u] Master: Unblocked process with PID %d to queue 0\n", shmp->vclk.sec, shmp->vclk.ns, pcb->id);
   }
 
   return rv;
 }
 
+//Sample CPU utilisation for each window of virtual time that ended
+static void estimate_util(){
+
+  const uint64_t now = VCLOCK_NS(shmp->vclk);
+  while(now >= util_window_end){
+    //busy time over a window is carried to the next one
+    uint64_t busy = busy_ns - util_mark;
+    if(busy > UTIL_WINDOW_NS){
+      busy = UTIL_WINDOW_NS;
+    }
+    util_mark += busy;
+
+    estimate_add(&est[EST_UTIL], (double) busy / UTIL_WINDOW_NS);
+    util_window_end += UTIL_WINDOW_NS;
+    est_updated = 1;
+  }
+}
+
+//Check if all estimates are within target precision
+static int estimate_done(){
+  int i;
+  for(i=0; i < EST_COUNT; i++){
+    if(!estimate_converged(&est[i], arg_e)){
+      return 0;
+    }
+  }
+  return 1;
+}
+
 int main(const int argc, char * const argv[])
 {
 
-  if(update_options(argc, argv) < 0){
-    master_exit(1);
+  //log is not open yet, nothing to clean up
+  const int rv_options = update_options(argc, argv);
+  if(rv_options != 0){
+    return (rv_options < 0) ? 1 : 0;
   }
 
   output = fopen(arg_l, "w");
@@ -520,52 +1630,68 @@ int main(const int argc, char * const argv[])
   //signal(SIGCHLD, master_waitall);
   signal(SIGTERM, sign_handler);
   signal(SIGALRM, sign_handler);
+  signal(SIGINT,  sign_handler);
+  signal(SIGHUP,  sign_handler);
   //alarm(arg_t);
 
+  //calibration mode, measure and save costs without running a simulation
+  if(arg_C){
+    struct cost_profile cp;
+    const int rv = (calibrate_run(&cp) < 0) || (cost_save(&cp, arg_C) < 0);
+    if(rv == 0){
+      fprintf(output,"Master: IPC round trip %lu ns, context switch %lu ns, cold cache %lu ns, saved to %s\n",
+        (unsigned long) cp.ipc, (unsigned long) cp.cswitch, (unsigned long) cp.cold, arg_C);
+    }
+    fclose(output);
+    return rv;
+  }
+
   if(master_initialize() < 0){
     master_exit(1);
   }
 
 
-  int idling = 0;
-  struct vclock idle_vclock = {0,0}, temp;
-  struct vclock fork_vclock = {0,0};
+  struct vclock fork_vclock = {0,0}, arrived;
+  struct arrival next;
 
 
   //run until interrupted
   while(!interrupted){
+    PROF_BEGIN(PROF_LOOP);
+
+    PROF_BEGIN(PROF_TIMER);
+    update_timer(shmp);
+    PROF_END(PROF_TIMER);
 
-    if(update_timer(shmp, &fork_vclock) > 0){
-      if(C < MAX_CHILDREN){
-        const pid_t pid = master_fork("./user");
-        fprintf(output,"[%u:%u] Master: Creating new child pid %i\n", shmp->vclk.sec, shmp->vclk.ns, pid);
+    //arrivals are open loop, take all that came while last burst ran
+    PROF_BEGIN(PROF_ADMIT);
+    while(!interrupted && arrival_due(&fork_vclock, arrival_can_fork(), &arrived, &next)){
+      if(C < arg_n){
+        master_arrival(&arrived, &next);
       }else{  //we have generated all of the children
         interrupted = 1;  //stop master loop
       }
     }
+    master_admit();
+    pcb_idle = pcbmap_avail(&pm);
+    PROF_END(PROF_ADMIT);
 
+    PROF_BEGIN(PROF_UNBLOCK);
     dispatch_bq();
+    PROF_END(PROF_UNBLOCK);
 
     //get a queue with ready process
+    PROF_BEGIN(PROF_READY);
     const int q_index = feedbackq_ready(fq, shmp->procs);
+    PROF_END(PROF_READY);
     if(q_index >= 0){
 
       //if we are in idle mode
-      if(idling){
-
-        //how much time we were idle
-        vclock_substract(&shmp->vclk, &idle_vclock, &temp);
-        fprintf(output,"[%u:%u] Master: End of idle mode of %u:%u.\n",
-          shmp->vclk.sec, shmp->vclk.ns, temp.sec, temp.ns);
-        vclock_increment(&vclk_stat[IDLE_TIME], &temp);
-
-        idle_vclock.sec  = 0;
-        idle_vclock.ns = 0;
-        idling = 0;
-      }
+      idle_end();
 
       if(dispatch_fq(q_index) < 0){
         fprintf(stderr, "Error: Dispatch failed.\n");
+        PROF_END(PROF_LOOP);
         break;
       }
 
@@ -573,30 +1699,38 @@ int main(const int argc, char * const argv[])
     }else{
 
       //set CPU mode to idling
-      if(idling == 0){
-        fprintf(output,"[%u:%u] Master: No process ready to dispatch.\n", shmp->vclk.sec, shmp->vclk.ns);
-        VCLOCK_COPY(idle_vclock, shmp->vclk);
-        idling = 1;
-      }
+      idle_begin();
 
-      //if we have processes blocked on IO
-      if(blockedq_size(&bq) > 0){
+      //if we have processes blocked on IO, that unblock before next arrival
+      if((blockedq_size(&bq) > 0) &&
+         (!arrival_can_fork() || (blockedq_wake(&bq) <= VCLOCK_NS(fork_vclock)))){
 
         struct process * pcb = &shmp->procs[blockedq_top(&bq)];
-        fprintf(output,"[%u:%u] Master: No process ready. Setting time to first unblock at %u:%u.\n",
-          shmp->vclk.sec, shmp->vclk.ns, pcb->vclk[BLOCKED_TIME].sec, pcb->vclk[BLOCKED_TIME].ns);
+        master_log("[%u:%u] Master: No process ready. Setting time to first unblock at %u:%u.\n",
+          shmp->vclk.sec, shmp->vclk.ns, PCB_VCLK(pcb)[BLOCKED_TIME].sec, PCB_VCLK(pcb)[BLOCKED_TIME].ns);
 
-        VCLOCK_COPY(shmp->vclk, pcb->vclk[BLOCKED_TIME]);
+        VCLOCK_COPY(shmp->vclk, PCB_VCLK(pcb)[BLOCKED_TIME]);
       }else{
         //jump to next fork time
-        fprintf(output,"[%u:%u] Master: No process ready. Setting time to next fork at %u:%u.\n",
+        master_log("[%u:%u] Master: No process ready. Setting time to next fork at %u:%u.\n",
           shmp->vclk.sec, shmp->vclk.ns, fork_vclock.sec, fork_vclock.ns);
         shmp->vclk = fork_vclock;
       }
     }
+
+    estimate_util();
+    if(est_updated && (arg_e > 0.0)){
+      est_updated = 0;
+      if(estimate_done()){
+        master_log("[%u:%u] Master: Estimates reached target precision, stopping\n", shmp->vclk.sec, shmp->vclk.ns);
+        est_done = 1;
+        interrupted = 1;
+      }
+    }
+    PROF_END(PROF_LOOP);
 	}
 
-  fprintf(output,"[%u:%u] Master exit\n", shmp->vclk.sec, shmp->vclk.ns);
+  master_log("[%u:%u] Master exit\n", shmp->vclk.sec, shmp->vclk.ns);
 	master_exit(0);
 
 	return 0;
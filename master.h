@@ -2,9 +2,15 @@
 #define MASTER_H
 
 #include <unistd.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "workload.h"
 
 #define MAX_USERS 18
 
+//size of a cache line, used to keep data written by different cores apart
+#define CACHE_LINE 64
+
 struct vclock {
   unsigned int sec;
 	unsigned int ns;
@@ -13,35 +19,53 @@ struct vclock {
 //helper functions for virtual clock
 #define VCLOCK_COPY(x,y) x.sec = y.sec; x.ns = y.ns;
 #define VCLOCK_AVE(x,count) x.sec /= count; x.ns /= count;
+#define VCLOCK_NS(x) ((uint64_t)(x).sec * 1000000000ULL + (x).ns)
+//n is evaluated once, it can be a call
+#define VCLOCK_FROM_NS(x,n) do{ const uint64_t vclock_ns_ = (n); \
+  (x).sec = vclock_ns_ / 1000000000ULL; (x).ns = vclock_ns_ % 1000000000ULL; }while(0)
 
 enum status_type { READY=1, IOBLK, TERMINATE, DECISON_COUNT};
-enum vclock_type { TOTAL_CPU=0, TOTAL_SYSTEM, BURST_TIME, FORK_TIME, BLOCKED_TIME, READY_TIME, VCLOCK_COUNT};
+enum vclock_type { TOTAL_CPU=0, TOTAL_SYSTEM, BURST_TIME, FORK_TIME, BLOCKED_TIME, READY_TIME, TOTAL_BLOCKED, VCLOCK_COUNT};
 
-// entry in the process control table
+// entry in the process control table, fills one cache line
 struct process {
+	//hot fields, touched on every dispatch
 	int	pid;
 	int id;
 	enum status_type state;
+	volatile int preempt;	//raised by master when quantum expires, in real mode
+	int job_class;	//index in shared classes, with a workload
+} __attribute__((aligned(CACHE_LINE)));
+
+_Static_assert(sizeof(struct process) == CACHE_LINE, "pcb must fit in one cache line");
 
+//cold statistics of a pcb, only used by master
+struct pcb_times {
 	struct vclock	vclk[VCLOCK_COUNT];
 };
 
 //The variables shared between master and palin processes
 struct shared {
-	struct vclock vclk;
+	struct vclock vclk __attribute__((aligned(CACHE_LINE)));	//master owned clock gets its own line
 	struct process procs[MAX_USERS];
+	struct pcb_times times[MAX_USERS];	//same index as procs
+
+	//job classes of workload, read by users
+	unsigned int nclasses;
+	struct job_class classes[MAX_CLASSES];
 };
 
 // quantum 10 ms ( in ns )
 #define QUANTUM_NS 10000000
 
-//shared memory constants
-#define FTOK_Q_PATH "/tmp"
-#define FTOK_SHM_PATH "/tmp"
-#define FTOK_Q_KEY 6776
-#define FTOK_SHM_KEY 7667
+//POSIX shared memory object, used with master -p. Name has master pid
+#define SHM_NAME_PREFIX "oss."
+#define SHM_NAME_FMT "/" SHM_NAME_PREFIX "%d"
+#define SHM_NAME_LEN 32
+//size of a huge page, shared memory is rounded to it with master -H
+#define HUGE_PAGE_SIZE (2*1024*1024)
 
-struct msgbuf {
+struct message {
 	long mtype;
 	pid_t from;
 
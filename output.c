@@ -0,0 +1,175 @@
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "output.h"
+#include "stats.h"
+#include "spscq.h"
+#include "thread.h"
+
+static FILE * output_file = NULL;
+static struct stats * output_st = NULL;
+
+static struct spscq ring;
+static pthread_t writer;
+static atomic_int stopping = 0;
+
+//Find end of next conversion in fmt. Sets wide, if argument is a long
+static const char * output_conversion(const char * fmt, int * wide){
+
+  *wide = 0;
+  while((fmt = strchr(fmt, '%')) != NULL){
+    if(fmt[1] == '%'){  //literal %
+      fmt += 2;
+      continue;
+    }
+
+    //skip flags and width, up to conversion letter
+    fmt++;
+    while(*fmt && strchr("-+ #0123456789.hlz", *fmt)){
+      if(*fmt == 'l' || *fmt == 'z'){
+        *wide = 1;
+      }
+      fmt++;
+    }
+    return (*fmt) ? fmt + 1 : fmt;
+  }
+  return NULL;
+}
+
+//Print log record, one conversion at a time, since arguments were saved as words
+static void output_print(const struct output_record * r){
+
+  char seg[256];
+  const char * fmt = r->log.fmt;
+  int n = 0, wide;
+
+  const char * end;
+  while((end = output_conversion(fmt, &wide)) != NULL){
+    size_t len = end - fmt;
+    if(len >= sizeof(seg)){
+      len = sizeof(seg) - 1;
+    }
+    memcpy(seg, fmt, len);
+    seg[len] = '\0';
+
+    if(wide){
+      fprintf(output_file, seg, r->log.args[n++]);
+    }else{
+      fprintf(output_file, seg, (int) r->log.args[n++]);
+    }
+    fmt = end;
+  }
+
+  //text after last conversion, only %% is left to unescape
+  const char * pct;
+  while((pct = strstr(fmt, "%%")) != NULL){
+    fwrite(fmt, 1, pct - fmt + 1, output_file);
+    fmt = pct + 2;
+  }
+  fputs(fmt, output_file);
+}
+
+static void output_record(const struct output_record * r){
+  if(r->type == OUTPUT_LOG){
+    output_print(r);
+  }else if(stats_append(output_st, &r->done.times) < 0){
+    fprintf(stderr, "Error: Saving stats of process with PID %d failed\n", r->done.pid);
+  }
+}
+
+//Take records from ring until master stops us
+static void * output_writer(void * arg){
+
+  struct output_record r;
+
+  while(1){
+    if(spscq_pop(&ring, &r) == 0){
+      output_record(&r);
+    }else if(stopping){
+      //records pushed before the flag was raised are visible now
+      while(spscq_pop(&ring, &r) == 0){
+        output_record(&r);
+      }
+      break;
+    }else{
+      usleep(100);
+    }
+  }
+  return NULL;
+}
+
+//Add record to ring. When full, we wait for output thread
+static void output_push(const struct output_record * r){
+  while(spscq_push(&ring, r) < 0){
+    sched_yield();
+  }
+}
+
+int output_start(FILE * fp, struct stats * st){
+
+  output_file = fp;
+  output_st = st;
+
+  if(spscq_init(&ring, OUTPUT_RING, sizeof(struct output_record)) < 0){
+    perror("malloc");
+    return -1;
+  }
+
+  if(thread_start(&writer, output_writer) < 0){
+    spscq_free(&ring);
+    output_file = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+//Wait for output thread to write all records
+void output_stop(){
+  if(output_file == NULL){
+    return;
+  }
+
+  stopping = 1;
+  pthread_join(writer, NULL);
+  spscq_free(&ring);
+  output_file = NULL;
+}
+
+//Check that fmt has only integer conversions, as many as a record holds
+int output_format_ok(const char * fmt){
+  int n = 0, wide;
+  const char * end;
+  while((end = output_conversion(fmt, &wide)) != NULL){
+    if(!strchr("diuxXoc", end[-1]) || (++n > OUTPUT_ARGS)){
+      return 0;
+    }
+    fmt = end;
+  }
+  return 1;
+}
+
+//Save log arguments for output thread. All arguments must be integers
+void output_log(const char * fmt, va_list ap){
+
+  struct output_record r;
+  const char * f = fmt;
+  int n = 0, wide;
+
+  r.type = OUTPUT_LOG;
+  r.log.fmt = fmt;
+  while((n < OUTPUT_ARGS) && ((f = output_conversion(f, &wide)) != NULL)){
+    r.log.args[n++] = (wide) ? va_arg(ap, long) : va_arg(ap, int);
+  }
+  output_push(&r);
+}
+
+//Save terminated process for stats
+void output_stats(const int pid, const struct pcb_times * t){
+  struct output_record r;
+  r.type = OUTPUT_STATS;
+  r.done.pid = pid;
+  r.done.times = *t;
+  output_push(&r);
+}
@@ -0,0 +1,37 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include "master.h"
+
+struct stats;
+
+/* Output stage of master -P. Dispatcher only copies log arguments and
+   finished pcbs to a lock-free ring, output thread formats, writes and
+   saves stats */
+
+//records waiting for output thread
+#define OUTPUT_RING 4096
+//most arguments of a log line
+#define OUTPUT_ARGS 8
+
+enum output_type { OUTPUT_LOG=0, OUTPUT_STATS };
+
+struct output_record {
+	enum output_type type;
+	union {
+		struct {
+			const char * fmt;	/* string literal, integer conversions only */
+			long args[OUTPUT_ARGS];
+		} log;
+		struct {
+			int pid;
+			struct pcb_times times;	/* copy of terminated process times */
+		} done;
+	};
+};
+
+int  output_start(FILE * fp, struct stats * st);
+void output_stop();
+
+int  output_format_ok(const char * fmt);
+void output_log(const char * fmt, va_list ap);
+void output_stats(const int pid, const struct pcb_times * t);
@@ -0,0 +1,41 @@
+#include <stdlib.h>
+#include "pcbmap.h"
+
+int pcbmap_init(struct pcbmap * pm, const int size){
+  pm->stack = (int*) malloc(sizeof(int)*size);
+  if(pm->stack == NULL){
+    return -1;
+  }
+
+  //lowest index is on top
+  int i;
+  for(i=0; i < size; i++){
+    pm->stack[i] = size - 1 - i;
+  }
+  pm->top = size;
+  pm->size = size;
+  return 0;
+}
+
+void pcbmap_free(struct pcbmap * pm){
+  free(pm->stack);
+  pm->stack = NULL;
+  pm->top = pm->size = 0;
+}
+
+//Take a free pcb, or -1 if all are used
+int pcbmap_get(struct pcbmap * pm){
+  return (pm->top > 0) ? pm->stack[--pm->top] : -1;
+}
+
+//Number of free pcbs
+int pcbmap_avail(const struct pcbmap * pm){
+  return pm->top;
+}
+
+//Mark a pcb as unused
+void pcbmap_put(struct pcbmap * pm, const int i){
+  if(pm->top < pm->size){
+    pm->stack[pm->top++] = i;
+  }
+}
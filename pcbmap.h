@@ -0,0 +1,15 @@
+#include "master.h"
+
+//stack of free pcb indexes
+struct pcbmap {
+	int * stack;
+	int top;	/* free pcbs */
+	int size;
+};
+
+int  pcbmap_init(struct pcbmap * pm, const int size);
+void pcbmap_free(struct pcbmap * pm);
+
+int  pcbmap_get(struct pcbmap * pm);
+int  pcbmap_avail(const struct pcbmap * pm);
+void pcbmap_put(struct pcbmap * pm, const int i);
@@ -0,0 +1,111 @@
+#include "profile.h"
+
+#ifdef PROFILE
+
+#include <stdint.h>
+#include <time.h>
+
+static const char * prof_names[PROF_PHASES] = {"loop (other)", "update_timer", "admission", "dispatch_bq",
+  "feedbackq_ready", "ipc round trip", "update_pcb_state", "update_queue", "logging"};
+
+/* all memory is preallocated, nothing is allocated while profiling */
+static struct {
+  uint64_t calls;
+  uint64_t total;
+  uint64_t max;
+  uint64_t hist[PROF_BUCKETS];
+} phases[PROF_PHASES];
+
+//stack of running phases, time of nested phase is not counted in its parent
+static struct {
+  enum prof_phase p;
+  uint64_t self;	/* time spent in phase itself */
+} stack[PROF_DEPTH];
+static int depth = 0;
+static uint64_t mark = 0;	/* when we last switched phase */
+
+static uint64_t prof_now(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+void profile_begin(const enum prof_phase p){
+  const uint64_t now = prof_now();
+
+  if(depth > 0){  //pause parent
+    stack[depth-1].self += now - mark;
+  }
+  if(depth < PROF_DEPTH){
+    stack[depth].p = p;
+    stack[depth].self = 0;
+  }
+  depth++;
+  mark = now;
+}
+
+void profile_end(const enum prof_phase p){
+  const uint64_t now = prof_now();
+
+  depth--;
+  if((depth < PROF_DEPTH) && (stack[depth].p == p)){
+    const uint64_t t = stack[depth].self + (now - mark);
+
+    phases[p].calls++;
+    phases[p].total += t;
+    if(t > phases[p].max){
+      phases[p].max = t;
+    }
+
+    int b = (t) ? 64 - __builtin_clzll(t) : 0;
+    if(b >= PROF_BUCKETS){
+      b = PROF_BUCKETS - 1;
+    }
+    phases[p].hist[b]++;
+  }
+  mark = now;
+}
+
+//Upper bound of bucket, where pct of phase calls are
+static uint64_t prof_percentile(const enum prof_phase p, const double pct){
+  const uint64_t want = (uint64_t)(phases[p].calls * pct / 100.0);
+  uint64_t seen = 0;
+  int b;
+  for(b=0; b < PROF_BUCKETS; b++){
+    seen += phases[p].hist[b];
+    if(seen > want){
+      break;
+    }
+  }
+  return (b) ? (1ULL << b) : 0;
+}
+
+void profile_report(FILE * fp){
+
+  uint64_t all = 0;
+  int i;
+  for(i=0; i < PROF_PHASES; i++){
+    all += phases[i].total;
+  }
+  if(all == 0){
+    return;
+  }
+
+  fprintf(fp, "Profile of master loop, time without nested phases:\n");
+  fprintf(fp, "%-18s %10s %12s %6s %10s %10s %10s %10s\n", "phase", "calls", "total ms", "%", "mean ns", "p50 ns <", "p99 ns <", "max ns");
+  for(i=0; i < PROF_PHASES; i++){
+    if(phases[i].calls == 0){
+      continue;
+    }
+    fprintf(fp, "%-18s %10lu %12.3f %6.2f %10lu %10lu %10lu %10lu\n", prof_names[i],
+      (unsigned long) phases[i].calls,
+      phases[i].total / 1000000.0,
+      (100.0 * phases[i].total) / all,
+      (unsigned long)(phases[i].total / phases[i].calls),
+      (unsigned long) prof_percentile(i, 50.0),
+      (unsigned long) prof_percentile(i, 99.0),
+      (unsigned long) phases[i].max);
+  }
+}
+
+#endif
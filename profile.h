@@ -0,0 +1,31 @@
+/* Profiler of master loop phases, built with make PROFILE=1.
+   Without PROFILE the macros are empty, so nothing is left in master */
+
+//phases of one master loop iteration
+enum prof_phase { PROF_LOOP=0, PROF_TIMER, PROF_ADMIT, PROF_UNBLOCK, PROF_READY, PROF_IPC,
+                  PROF_UPDATE_PCB, PROF_UPDATE_QUEUE, PROF_LOG, PROF_PHASES };
+
+//log2 buckets of phase time, in ns
+#define PROF_BUCKETS 32
+//phases that can be nested
+#define PROF_DEPTH 8
+
+#ifdef PROFILE
+
+#include <stdio.h>
+
+void profile_begin(const enum prof_phase p);
+void profile_end(const enum prof_phase p);
+void profile_report(FILE * fp);
+
+#define PROF_BEGIN(p)   profile_begin(p)
+#define PROF_END(p)     profile_end(p)
+#define PROF_REPORT(fp) profile_report(fp)
+
+#else
+
+#define PROF_BEGIN(p)
+#define PROF_END(p)
+#define PROF_REPORT(fp)
+
+#endif
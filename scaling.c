@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "master.h"
+#include "pcbmap.h"
+#include "feedbackq.h"
+#include "blockedq.h"
+
+//smallest and largest number of pcbs we test
+#define SCALING_MIN 16
+#define SCALING_MAX (1024 * 1024)
+//time each measurement runs for, we keep the fastest
+#define SCALING_RUN_NS 20000000ULL
+#define SCALING_REPEAT 3
+//cost can grow as n^x faster than its bound, before we fail. O(sqrt n) in place of O(1) is 0.5
+#define SCALING_SLACK 0.2
+
+enum bound { BOUND_1, BOUND_LOGN };
+static const char * bound_name[] = {"O(1)", "O(log n)"};
+
+struct operation {
+  const char * name;
+  enum bound bound;
+  void  (*setup)(const int n);
+  void  (*run)(const unsigned int ops);
+  void  (*teardown)();
+  double ns[32];  //time per op, by size
+};
+
+static struct process * procs = NULL;
+static struct pcbmap pm;
+static struct feedbackq fq[FEEDBACK_LEVELS];
+static struct blockedq bq;
+static uint64_t bq_clock = 0;
+static unsigned short seed[3] = {0x330E, 0x5CA1, 0x0001};
+static volatile int sink = 0;
+
+static uint64_t now_ns(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+//pcb table with n-1 used pcbs, we take and release the last one
+static void pcbmap_setup(const int n){
+  pcbmap_init(&pm, n);
+  int i;
+  for(i=0; i < n - 1; i++){
+    pcbmap_get(&pm);
+  }
+}
+
+static void pcbmap_run(const unsigned int ops){
+  unsigned int i;
+  for(i=0; i < ops; i++){
+    const int pi = pcbmap_get(&pm);
+    pcbmap_put(&pm, pi);
+    sink += pi;
+  }
+}
+
+static void pcbmap_teardown(){
+  pcbmap_free(&pm);
+}
+
+//n ready processes in the top queue, we dispatch the first and requeue it
+static void feedbackq_setup(const int n){
+  procs = (struct process*) calloc(n, sizeof(struct process));
+  feedbackq_init(fq, n);
+  int i;
+  for(i=0; i < n; i++){
+    procs[i].state = READY;
+    feedbackq_enq(&fq[0], i);
+  }
+}
+
+static void feedbackq_run(const unsigned int ops){
+  unsigned int i;
+  for(i=0; i < ops; i++){
+    const int q = feedbackq_ready(fq, procs);
+    const int pi = feedbackq_deq(&fq[q]);
+    feedbackq_enq(&fq[q], pi);
+    sink += pi;
+  }
+}
+
+static void feedbackq_teardown(){
+  feedbackq_free(fq);
+  free(procs);
+}
+
+//n blocked processes, we unblock earliest one and block it again later
+static void blockedq_setup(const int n){
+  blockedq_init(&bq, n);
+  bq_clock = 0;
+  int i;
+  for(i=0; i < n; i++){
+    blockedq_enq(&bq, i, nrand48(seed) % 1000000);
+  }
+}
+
+static void blockedq_run(const unsigned int ops){
+  unsigned int i;
+  for(i=0; i < ops; i++){
+    const int pi = blockedq_top(&bq);
+    bq_clock = blockedq_wake(&bq) + 1;  //jump to first unblock, like master does
+    blockedq_ready(&bq, bq_clock);
+    blockedq_enq(&bq, pi, bq_clock + (nrand48(seed) % 1000000));
+    sink += pi;
+  }
+}
+
+static void blockedq_teardown(){
+  blockedq_free(&bq);
+}
+
+static struct operation operations[] = {
+  {"pcbmap get/put",   BOUND_1,    pcbmap_setup,    pcbmap_run,    pcbmap_teardown},
+  {"feedbackq deq/enq", BOUND_1,    feedbackq_setup, feedbackq_run, feedbackq_teardown},
+  {"blockedq ready/enq", BOUND_LOGN, blockedq_setup,  blockedq_run,  blockedq_teardown},
+};
+#define NOPERATIONS (sizeof(operations) / sizeof(struct operation))
+
+//time of one op at size n, in ns
+static double measure(struct operation * op, const int n){
+  double best = 0.0;
+  int r;
+
+  op->setup(n);
+  op->run(n); //warm up, touch all of the memory
+
+  for(r=0; r < SCALING_REPEAT; r++){
+    unsigned int ops = 0;
+    const uint64_t t0 = now_ns();
+    uint64_t t1;
+    do{
+      op->run(64);
+      ops += 64;
+      t1 = now_ns();
+    }while((t1 - t0) < SCALING_RUN_NS);
+
+    const double ns = (double)(t1 - t0) / ops;
+    if((r == 0) || (ns < best)){
+      best = ns;
+    }
+  }
+  op->teardown();
+  return best;
+}
+
+static double bound_value(const enum bound b, const int n){
+  return (b == BOUND_LOGN) ? log2(n) : 1.0;
+}
+
+//least squares slope of log(time/bound) against log(n)
+static double excess_exponent(const struct operation * op, const int * sizes, const int nsizes){
+  double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+  int i;
+  for(i=0; i < nsizes; i++){
+    const double x = log(sizes[i]);
+    const double y = log(op->ns[i] / bound_value(op->bound, sizes[i]));
+    sx += x; sy += y; sxx += x*x; sxy += x*y;
+  }
+  return ((nsizes * sxy) - (sx * sy)) / ((nsizes * sxx) - (sx * sx));
+}
+
+int main(const int argc, char * const argv[]){
+  int sizes[32], nsizes = 0, n;
+  unsigned int i;
+  int j, rv = 0;
+
+  int max = SCALING_MAX;
+  if(argc > 1){
+    max = atoi(argv[1]);
+  }
+
+  for(n=SCALING_MIN; n <= max; n *= 4){
+    sizes[nsizes++] = n;
+  }
+  if(nsizes < 2){
+    fprintf(stderr, "Error: need at least two sizes, max is %d\n", max);
+    return 1;
+  }
+
+  printf("%-20s", "ns per op");
+  for(j=0; j < nsizes; j++){
+    printf(" %8d", sizes[j]);
+  }
+  printf("\n");
+
+  for(i=0; i < NOPERATIONS; i++){
+    struct operation * op = &operations[i];
+    printf("%-20s", op->name);
+    for(j=0; j < nsizes; j++){
+      op->ns[j] = measure(op, sizes[j]);
+      printf(" %8.1f", op->ns[j]);
+      fflush(stdout);
+    }
+    printf("\n");
+  }
+
+  printf("\n%-20s %-10s %s\n", "operation", "bound", "excess exponent");
+  for(i=0; i < NOPERATIONS; i++){
+    struct operation * op = &operations[i];
+    const double x = excess_exponent(op, sizes, nsizes);
+    const int fail = (x > SCALING_SLACK);
+    printf("%-20s %-10s %6.2f %s\n", op->name, bound_name[op->bound], x, fail ? "FAIL" : "ok");
+    if(fail){
+      rv = 1;
+    }
+  }
+  return rv;
+}
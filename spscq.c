@@ -0,0 +1,53 @@
+#include <stdlib.h>
+#include <string.h>
+#include "spscq.h"
+
+int spscq_init(struct spscq * q, const unsigned int capacity, const unsigned int elem_size){
+  unsigned int size = 1;
+  while(size < capacity){
+    size <<= 1;
+  }
+
+  q->buf = (char*) malloc(size * elem_size);
+  if(q->buf == NULL){
+    return -1;
+  }
+  q->mask = size - 1;
+  q->elem_size = elem_size;
+  atomic_init(&q->head, 0);
+  atomic_init(&q->tail, 0);
+  return 0;
+}
+
+void spscq_free(struct spscq * q){
+  free(q->buf);
+  q->buf = NULL;
+}
+
+//Add e to queue, returns -1 if queue is full
+int spscq_push(struct spscq * q, const void * e){
+  const unsigned int tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  const unsigned int head = atomic_load_explicit(&q->head, memory_order_acquire);
+
+  if((tail - head) > q->mask){
+    return -1;
+  }
+
+  memcpy(&q->buf[(tail & q->mask) * q->elem_size], e, q->elem_size);
+  atomic_store_explicit(&q->tail, tail + 1, memory_order_release);  //publish element
+  return 0;
+}
+
+//Take oldest item from queue, returns -1 if queue is empty
+int spscq_pop(struct spscq * q, void * e){
+  const unsigned int head = atomic_load_explicit(&q->head, memory_order_relaxed);
+  const unsigned int tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+  if(head == tail){
+    return -1;
+  }
+
+  memcpy(e, &q->buf[(head & q->mask) * q->elem_size], q->elem_size);
+  atomic_store_explicit(&q->head, head + 1, memory_order_release);  //free the slot
+  return 0;
+}
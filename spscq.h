@@ -0,0 +1,19 @@
+#include <stdatomic.h>
+#include "master.h"
+
+/* Lock-free ring between one producer and one consumer thread.
+   Capacity is rounded to a power of 2 */
+struct spscq {
+	_Atomic unsigned int head __attribute__((aligned(CACHE_LINE)));	/* next to pop, moved by consumer */
+	_Atomic unsigned int tail __attribute__((aligned(CACHE_LINE)));	/* next to push, moved by producer */
+
+	unsigned int mask __attribute__((aligned(CACHE_LINE)));
+	unsigned int elem_size;
+	char * buf;
+};
+
+int  spscq_init(struct spscq * q, const unsigned int capacity, const unsigned int elem_size);
+void spscq_free(struct spscq * q);
+
+int spscq_push(struct spscq * q, const void * e);
+int spscq_pop(struct spscq * q, void * e);
@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <string.h>
+#include "stats.h"
+
+int stats_init(struct stats * st, const unsigned int capacity){
+  int i;
+  for(i=0; i < STAT_COUNT; i++){
+    st->col[i] = (uint64_t*) malloc(sizeof(uint64_t)*capacity);
+    if(st->col[i] == NULL){
+      return -1;
+    }
+  }
+  st->count = 0;
+  st->capacity = capacity;
+  return 0;
+}
+
+void stats_free(struct stats * st){
+  int i;
+  for(i=0; i < STAT_COUNT; i++){
+    free(st->col[i]);
+    st->col[i] = NULL;
+  }
+  st->count = st->capacity = 0;
+}
+
+//double the columns when full
+static int stats_grow(struct stats * st){
+  const unsigned int capacity = (st->capacity) ? st->capacity * 2 : 64;
+  int i;
+  for(i=0; i < STAT_COUNT; i++){
+    uint64_t * col = (uint64_t*) realloc(st->col[i], sizeof(uint64_t)*capacity);
+    if(col == NULL){
+      return -1;
+    }
+    st->col[i] = col;
+  }
+  st->capacity = capacity;
+  return 0;
+}
+
+//save the record of a terminated process
+int stats_append(struct stats * st, const struct pcb_times * t){
+  if((st->count == st->capacity) && (stats_grow(st) < 0)){
+    return -1;
+  }
+
+  const unsigned int n = st->count++;
+  st->col[STAT_FORK][n]    = VCLOCK_NS(t->vclk[FORK_TIME]);
+  st->col[STAT_CPU][n]     = VCLOCK_NS(t->vclk[TOTAL_CPU]);
+  st->col[STAT_SYSTEM][n]  = VCLOCK_NS(t->vclk[TOTAL_SYSTEM]);
+  st->col[STAT_BLOCKED][n] = VCLOCK_NS(t->vclk[TOTAL_BLOCKED]);
+
+  /* time in ready queues is what is left from system time */
+  const uint64_t used = st->col[STAT_CPU][n] + st->col[STAT_BLOCKED][n];
+  st->col[STAT_READY][n] = (st->col[STAT_SYSTEM][n] > used) ? st->col[STAT_SYSTEM][n] - used : 0;
+  return 0;
+}
+
+/* Passes below are kept branch-free and separate, so compiler can vectorize them */
+
+static uint64_t column_sum(const uint64_t * restrict x, const unsigned int n){
+  uint64_t sum = 0;
+  unsigned int i;
+  for(i=0; i < n; i++){
+    sum += x[i];
+  }
+  return sum;
+}
+
+static uint64_t column_min(const uint64_t * restrict x, const unsigned int n){
+  uint64_t min = UINT64_MAX;
+  unsigned int i;
+  for(i=0; i < n; i++){
+    min = (x[i] < min) ? x[i] : min;
+  }
+  return min;
+}
+
+static uint64_t column_max(const uint64_t * restrict x, const unsigned int n){
+  uint64_t max = 0;
+  unsigned int i;
+  for(i=0; i < n; i++){
+    max = (x[i] > max) ? x[i] : max;
+  }
+  return max;
+}
+
+static void column_hist(const uint64_t * restrict x, const unsigned int n, unsigned int hist[STATS_BUCKETS]){
+  unsigned int i;
+  for(i=0; i < n; i++){
+    int b = (x[i]) ? 64 - __builtin_clzll(x[i]) : 0;
+    if(b >= STATS_BUCKETS){
+      b = STATS_BUCKETS - 1;
+    }
+    hist[b]++;
+  }
+}
+
+void stats_summary(const struct stats * st, const enum stats_column c, struct stats_summary * sum){
+  memset(sum, 0, sizeof(struct stats_summary));
+  if(st->count == 0){
+    return;
+  }
+
+  sum->sum = column_sum(st->col[c], st->count);
+  sum->min = column_min(st->col[c], st->count);
+  sum->max = column_max(st->col[c], st->count);
+  column_hist(st->col[c], st->count, sum->hist);
+}
+
+static int column_cmp(const void * a, const void * b){
+  const uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return (x > y) - (x < y);
+}
+
+//Value below which p percent of column is, sorts a copy of column
+uint64_t stats_percentile(const struct stats * st, const enum stats_column c, const double p){
+  if(st->count == 0){
+    return 0;
+  }
+
+  uint64_t * sorted = (uint64_t*) malloc(sizeof(uint64_t)*st->count);
+  if(sorted == NULL){
+    return 0;
+  }
+  memcpy(sorted, st->col[c], sizeof(uint64_t)*st->count);
+  qsort(sorted, st->count, sizeof(uint64_t), column_cmp);
+
+  unsigned int i = (unsigned int)((p / 100.0) * st->count);
+  if(i >= st->count){
+    i = st->count - 1;
+  }
+  const uint64_t v = sorted[i];
+  free(sorted);
+  return v;
+}
@@ -0,0 +1,28 @@
+#include <stdint.h>
+#include "master.h"
+
+//columns saved for each completed job, all in ns
+enum stats_column { STAT_FORK=0, STAT_CPU, STAT_SYSTEM, STAT_BLOCKED, STAT_READY, STAT_COUNT };
+
+//log2 buckets in histogram
+#define STATS_BUCKETS 48
+
+struct stats {
+	uint64_t * col[STAT_COUNT];	/* struct of arrays, one column per stat */
+	unsigned int count;
+	unsigned int capacity;
+};
+
+struct stats_summary {
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	unsigned int hist[STATS_BUCKETS];	/* hist[i] counts values in [2^(i-1), 2^i) */
+};
+
+int  stats_init(struct stats * st, const unsigned int capacity);
+void stats_free(struct stats * st);
+
+int  stats_append(struct stats * st, const struct pcb_times * t);
+void stats_summary(const struct stats * st, const enum stats_column c, struct stats_summary * sum);
+uint64_t stats_percentile(const struct stats * st, const enum stats_column c, const double p);
@@ -0,0 +1,20 @@
+#include <stdio.h>
+#include <signal.h>
+#include <pthread.h>
+#include "thread.h"
+
+int thread_start(pthread_t * tid, void * (*fn)(void *)){
+
+  //new thread inherits our mask, so block everything while we create it
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  const int rv = pthread_create(tid, NULL, fn, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+  if(rv != 0){
+    fprintf(stderr, "Error: pthread_create failed\n");
+    return -1;
+  }
+  return 0;
+}
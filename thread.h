@@ -0,0 +1,4 @@
+#include <pthread.h>
+
+//Start a helper thread with all signals blocked, they are for the dispatcher
+int thread_start(pthread_t * tid, void * (*fn)(void *));
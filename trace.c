@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "trace.h"
+#include "thread.h"
+
+static FILE * trace_file = NULL;
+static pthread_t writer;
+
+/* events are formatted by writer thread, not on dispatch path */
+static struct trace_event ring[TRACE_RING];
+static unsigned int head = 0, count = 0;
+static int closing = 0;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t not_empty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t not_full  = PTHREAD_COND_INITIALIZER;
+
+static const char * slice_names[TRACE_TYPE_COUNT] = {"running", "ready", "blocked", "idle", "thread_name"};
+
+//thread id on the timeline, CPU is 0
+static int trace_tid(const int id){
+  return id + 1;
+}
+
+static void trace_write(const struct trace_event * ev){
+
+  static const char * sep = ",\n"; //CPU name is always the first event
+
+  if(ev->type == TRACE_NAME){
+    fprintf(trace_file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"PID %d\"}}",
+      sep, trace_tid(ev->id), ev->id);
+
+  }else if(ev->type == TRACE_READY){
+    fprintf(trace_file, "%s{\"name\":\"ready q%d\",\"cat\":\"ready\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+      sep, ev->queue, ev->ts / 1000.0, ev->dur / 1000.0, trace_tid(ev->id));
+
+  }else{
+    fprintf(trace_file, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+      sep, slice_names[ev->type], slice_names[ev->type], ev->ts / 1000.0, ev->dur / 1000.0, trace_tid(ev->id));
+  }
+}
+
+//Take events from ring, in batches, and write them to file
+static void * trace_writer(void * arg){
+
+  static struct trace_event batch[TRACE_RING];
+
+  while(1){
+    pthread_mutex_lock(&lock);
+    while((count == 0) && !closing){
+      pthread_cond_wait(&not_empty, &lock);
+    }
+
+    if((count == 0) && closing){
+      pthread_mutex_unlock(&lock);
+      break;
+    }
+
+    //copy out everything we have
+    const unsigned int n = count;
+    unsigned int i;
+    for(i=0; i < n; i++){
+      batch[i] = ring[(head + i) % TRACE_RING];
+    }
+    head = (head + n) % TRACE_RING;
+    count = 0;
+    pthread_cond_signal(&not_full);
+    pthread_mutex_unlock(&lock);
+
+    for(i=0; i < n; i++){
+      trace_write(&batch[i]);
+    }
+  }
+  return NULL;
+}
+
+static void trace_push(const struct trace_event * ev){
+
+  if(trace_file == NULL){
+    return;
+  }
+
+  pthread_mutex_lock(&lock);
+  while(count == TRACE_RING){ //writer is behind
+    pthread_cond_wait(&not_full, &lock);
+  }
+  ring[(head + count) % TRACE_RING] = *ev;
+  count++;
+
+  //wake writer only when a batch is ready
+  if(count == (TRACE_RING / 4)){
+    pthread_cond_signal(&not_empty);
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+int trace_open(const char * path){
+
+  trace_file = fopen(path, "w");
+  if(trace_file == NULL){
+    perror("fopen");
+    return -1;
+  }
+
+  fprintf(trace_file, "{\"traceEvents\":[\n");
+  fprintf(trace_file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"CPU\"}}");
+
+  if(thread_start(&writer, trace_writer) < 0){
+    fclose(trace_file);
+    trace_file = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+void trace_close(){
+
+  if(trace_file == NULL){
+    return;
+  }
+
+  pthread_mutex_lock(&lock);
+  closing = 1;
+  pthread_cond_signal(&not_empty);
+  pthread_mutex_unlock(&lock);
+
+  pthread_join(writer, NULL);
+
+  fprintf(trace_file, "\n],\"displayTimeUnit\":\"ns\"}\n");
+  fclose(trace_file);
+  trace_file = NULL;
+}
+
+void trace_slice(const enum trace_type type, const int id, const int queue, const uint64_t start, const uint64_t end){
+  struct trace_event ev;
+  ev.type  = type;
+  ev.id    = id;
+  ev.queue = queue;
+  ev.ts    = start;
+  ev.dur   = (end > start) ? end - start : 0;
+  trace_push(&ev);
+}
+
+void trace_name(const int id){
+  struct trace_event ev;
+  memset(&ev, 0, sizeof(struct trace_event));
+  ev.type = TRACE_NAME;
+  ev.id   = id;
+  trace_push(&ev);
+}
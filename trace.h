@@ -0,0 +1,21 @@
+#include <stdint.h>
+
+//slices on the timeline
+enum trace_type { TRACE_RUNNING=0, TRACE_READY, TRACE_BLOCKED, TRACE_IDLE, TRACE_NAME, TRACE_TYPE_COUNT };
+
+//events waiting for writer thread
+#define TRACE_RING 4096
+
+struct trace_event {
+	enum trace_type type;
+	int id;		/* process id, or -1 for the CPU */
+	int queue;	/* feedback queue, for ready slices */
+	uint64_t ts;	/* start time, in virtual ns */
+	uint64_t dur;	/* duration, in virtual ns */
+};
+
+int  trace_open(const char * path);
+void trace_close();
+
+void trace_slice(const enum trace_type type, const int id, const int queue, const uint64_t start, const uint64_t end);
+void trace_name(const int id);
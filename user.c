@@ -3,6 +3,9 @@
 #include <sys/ipc.h>
 #include <sys/msg.h>
 #include <sys/shm.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <time.h>
 #include <stdlib.h>
@@ -11,44 +14,62 @@
 
 static int shmid = -1, msgid = -1;  //semaphore identifier
 static struct shared * shmp = NULL;
+static int shm_posix = 0;	//shared memory is from shm_open
+static int real_mode = 0;	//burn CPU instead of reporting a random time
+static struct process * pcb = NULL;	//our entry in process table
 
-//Initialize the shared memory pointer
-static int shared_initialize()
+//with a workload, our job class and CPU left to use
+static const struct job_class * jc = NULL;
+static uint64_t demand_left = 0;
+static unsigned short seed[3];
+
+//Map the shared memory created by master with shm_open
+static int shared_posix_initialize()
 {
-	key_t key = ftok(FTOK_SHM_PATH, FTOK_SHM_KEY);  //get a key for the shared memory
-	if(key == -1){
-		perror("ftok");
+	char name[SHM_NAME_LEN];
+	snprintf(name, SHM_NAME_LEN, SHM_NAME_FMT, getppid());	//master is our parent
+
+	const int fd = shm_open(name, O_RDWR, 0);
+	if(fd == -1){
+		perror("shm_open");
 		return -1;
 	}
 
-	shmid = shmget(key, 0, 0);
-	if(shmid == -1){
-		perror("shmget");
+	void * addr = mmap(NULL, sizeof(struct shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(addr == MAP_FAILED){
+		perror("mmap");
 		return -1;
 	}
 
-  shmp = (struct shared*) shmat(shmid, NULL, 0); //attach it
-  if(shmp == NULL){
+	shmp = (struct shared*) addr;
+	return 0;
+}
+
+//Attach the shared memory created by master with shmget
+static int shared_sysv_initialize()
+{
+  shmp = (struct shared*) shmat(shmid, NULL, 0); //attach it, id is from master
+  if(shmp == (void*) -1){
 		perror("shmat");
+		shmp = NULL;
 		return -1;
 	}
+	return 0;
+}
 
-  key = ftok(FTOK_Q_PATH, FTOK_Q_KEY);
-	if(key == -1){
-		perror("ftok");
+//Initialize the shared memory pointer
+static int shared_initialize()
+{
+	const int rv = (shm_posix) ? shared_posix_initialize() : shared_sysv_initialize();
+	if(rv < 0){
 		return -1;
 	}
 
-	msgid = msgget(key, 0);
-	if(msgid == -1){
-		perror("msgget");
-		return EXIT_FAILURE;
-	}
-
 	return 0;
 }
 
-static int send_msg(const int msgid, struct msgbuf *m)
+static int send_msg(const int msgid, struct message *m)
 {
 	m->mtype = getppid();	//send to parent
 	m->from = getpid();	//mark who is sending the message
@@ -59,7 +80,7 @@ static int send_msg(const int msgid, struct msgbuf *m)
 	return 0;
 }
 
-static int get_msg(const int msgid, struct msgbuf *m){
+static int get_msg(const int msgid, struct message *m){
 	if(msgrcv(msgid, (void*)m, MSG_SIZE, getpid(), 0) == -1){
 		perror("msgrcv");
 		return -1;
@@ -67,6 +88,46 @@ static int get_msg(const int msgid, struct msgbuf *m){
 	return 0;
 }
 
+//Find our entry in the process control table
+static struct process * find_pcb(){
+	int i;
+	const pid_t me = getpid();
+	for(i=0; i < MAX_USERS; i++){
+		if(shmp->procs[i].pid == me){
+			return &shmp->procs[i];
+		}
+	}
+	return NULL;
+}
+
+//CPU time used by this thread, in ns
+static unsigned long cpu_ns(){
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (ts.tv_sec * 1000000000UL) + ts.tv_nsec;
+}
+
+//Burn CPU until we used max_ns, or master preempts us. Returns CPU time used
+static int burn_cpu(const unsigned long max_ns){
+	static volatile unsigned long work = 0;
+	const unsigned long start = cpu_ns();
+	unsigned long used = 0;
+
+	while(!pcb->preempt && (used < max_ns)){
+		int i;
+		for(i=0; i < 1000; i++){	//check the clock only once in a while
+			work = (work * 1103515245) + 12345;
+		}
+		used = cpu_ns() - start;
+	}
+	return (int) used;
+}
+
+//Most CPU we can use in a burst
+static unsigned long burst_limit(){
+	return (jc && (jc->demand.type != DIST_NONE)) ? demand_left : ~0UL;
+}
+
 static int decide_action()
 {
 	//10 % chance to terminate
@@ -78,32 +139,67 @@ static int decide_action()
 	return action;
 }
 
-static void msg_use_quantum(struct msgbuf *msg, const int q){
+//Decide using chances from our job class
+static int decide_class_action()
+{
+	const int r = rand() % 100;
+
+	if(r < jc->terminate){
+		return 3;
+	}else if(r < (jc->terminate + jc->block)){
+		return 2;
+	}else if(r < (jc->terminate + jc->block + jc->preempt)){
+		return 1;
+	}
+	return 0;
+}
+
+static void msg_use_quantum(struct message *msg, const int q){
 	msg->msg = READY;
 	msg->quant_s = 0;
-	msg->quant_ns = q;
+	if(real_mode){
+		msg->quant_ns = burn_cpu(burst_limit());	//in real mode we run until preempted
+	}else{
+		msg->quant_ns = (q < burst_limit()) ? q : burst_limit();
+	}
 }
 
-static void msg_block_io(struct msgbuf *msg){
+static void msg_block_io(struct message *msg){
 
 	static const int r = 3;
 	static const int s = 1000;
 
 	msg->msg = IOBLK;
-	msg->quant_s	 = rand() % r;
-	msg->quant_ns = rand() % s;
+	if(jc && (jc->device >= 0)){	//master times IO on the device
+		msg->quant_s  = 0;
+		msg->quant_ns = 0;
+	}else if(jc){
+		const uint64_t t = dist_sample(&jc->io, seed);
+		msg->quant_s  = t / 1000000000ULL;
+		msg->quant_ns = t % 1000000000ULL;
+	}else{
+		msg->quant_s	 = rand() % r;
+		msg->quant_ns = rand() % s;
+	}
 }
 
-static void msg_use_quantum_preempt(struct msgbuf *msg, const int q){
+static void msg_use_quantum_preempt(struct message *msg, const int q){
 	static const float preempt_min = 1.0f;
 	static const int preempt_max = 99;
 
 	msg->msg = READY;
 	msg->quant_s = 0;
 	msg->quant_ns = (int)((float) q / (100.0f / (preempt_min + (rand() % preempt_max))));
+	if(msg->quant_ns > burst_limit()){
+		msg->quant_ns = burst_limit();
+	}
+
+	if(real_mode){
+		msg->quant_ns = burn_cpu(msg->quant_ns);
+	}
 }
 
-static void msg_terminate(struct msgbuf *msg){
+static void msg_terminate(struct message *msg){
 	msg->msg = TERMINATE;
 	msg->quant_s = 0;
 	msg->quant_ns = 0;
@@ -111,14 +207,29 @@ static void msg_terminate(struct msgbuf *msg){
 
 int main(const int argc, char * const argv[]){
 
-	struct msgbuf msg;
+	struct message msg;
 
-	if(shared_initialize() < 0){
+	int opt;
+	while((opt=getopt(argc, argv, "prs:q:")) != -1){
+		switch(opt){
+			case 'p':	shm_posix = 1;	break;
+			case 'r':	real_mode = 1;	break;
+			case 's':	shmid = atoi(optarg);	break;
+			case 'q':	msgid = atoi(optarg);	break;
+			default:
+				fprintf(stderr, "Error: Invalid option '%c'\n", opt);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if((msgid == -1) || (!shm_posix && (shmid == -1))){
+		fprintf(stderr, "Error: user needs -q msgid, and -s shmid without -p\n");
 		return EXIT_FAILURE;
 	}
 
-	//initialize the rand() function
-	srand(getpid());
+	if(shared_initialize() < 0){
+		return EXIT_FAILURE;
+	}
 
 	int terminate_me = 0;
 	while(terminate_me == 0){
@@ -130,7 +241,26 @@ int main(const int argc, char * const argv[]){
 		//printf("SLICE=%d\n", msg.quant_ns);
 		//fflush(stdout);
 
-		switch(decide_action()){
+		if(pcb == NULL){
+			pcb = find_pcb();
+			if(pcb == NULL){
+				fprintf(stderr, "Error: User %d has no pcb\n", getpid());
+				break;
+			}
+
+			//initialize the rand() function. Seed is our process number, so runs can be repeated
+			srand(pcb->id + 1);
+			seed[0] = 0x330E;
+			seed[1] = pcb->id & 0xFFFF;
+			seed[2] = pcb->id >> 16;
+
+			if(shmp->nclasses){
+				jc = &shmp->classes[pcb->job_class];
+				demand_left = dist_sample(&jc->demand, seed);
+			}
+		}
+
+		switch((jc) ? decide_class_action() : decide_action()){
 			case 0:	msg_use_quantum(&msg, msg.quant_ns);				break;
 			case 1: msg_use_quantum_preempt(&msg,msg.quant_ns);	break;
 			case 2:	msg_block_io(&msg);													break;
@@ -140,12 +270,25 @@ int main(const int argc, char * const argv[]){
 				break;
 		}
 
+		//job ends when its CPU demand is used
+		if(jc && (jc->demand.type != DIST_NONE) && (msg.msg == READY)){
+			demand_left -= (msg.quant_ns < demand_left) ? msg.quant_ns : demand_left;
+			if(demand_left == 0){
+				msg.msg = TERMINATE;
+				terminate_me = 1;
+			}
+		}
+
 		//send request to enter critical section to master
 		if(send_msg(msgid, &msg) == EXIT_FAILURE){	//lock shared oss clock
 			break;
 		}
 	}
 
-	shmdt(shmp);
+	if(shm_posix){
+		munmap(shmp, sizeof(struct shared));
+	}else{
+		shmdt(shmp);
+	}
 	return EXIT_SUCCESS;
 }
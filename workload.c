@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "workload.h"
+
+/* Workload file, one setting per line, # starts a comment
+
+   arrival exp 250000             time between arrivals
+   device disk0 elevator exp 5000000 1000 2000
+                                  device with fifo or elevator queue, service time,
+                                  and optional tracks and ns to seek one track
+   class batch 3                  start a class with weight 3
+   demand pareto 5000000 1.5      total CPU of class jobs
+   io exp 50000000                time class jobs block on IO
+   io disk0                       or do IO on a device, declared before
+   block 20                       % chance to block on IO, per dispatch
+   preempt 30                     % chance to be preempted, per dispatch
+   terminate 10                   % chance to terminate, when there is no demand
+
+   Distributions are: const v, uniform min max, exp mean, pareto scale shape,
+   bursty burst_mean calm_mean switch_chance (arrival only)
+*/
+
+static const char * dist_names[] = {"none", "const", "uniform", "exp", "pareto", "bursty"};
+
+//Parse a distribution named name, parameters are from strtok
+static int dist_parse_named(struct dist * d, const char * name){
+
+  int i;
+  d->type = DIST_NONE;
+  for(i=DIST_CONST; i <= DIST_BURSTY; i++){
+    if(strcmp(name, dist_names[i]) == 0){
+      d->type = i;
+      break;
+    }
+  }
+  if(d->type == DIST_NONE){
+    return -1;
+  }
+
+  double * params[3] = {&d->a, &d->b, &d->c};
+  static const int nparams[] = {0, 1, 2, 1, 2, 3};
+  for(i=0; i < nparams[d->type]; i++){
+    const char * tok = strtok(NULL, " \t\n");
+    if(tok == NULL){
+      return -1;
+    }
+    *params[i] = atof(tok);
+  }
+
+  if( ((d->type == DIST_PARETO) && (d->b <= 0.0)) ||
+      ((d->type == DIST_UNIFORM) && (d->b < d->a))){
+    return -1;
+  }
+  return 0;
+}
+
+//Parse a distribution from strtok
+static int dist_parse(struct dist * d){
+
+  const char * name = strtok(NULL, " \t\n");
+  if(name == NULL){
+    return -1;
+  }
+  return dist_parse_named(d, name);
+}
+
+//Parse a device from strtok
+static int device_parse(struct device_spec * dev){
+
+  const char * name = strtok(NULL, " \t\n");
+  const char * policy = strtok(NULL, " \t\n");
+  if((name == NULL) || (policy == NULL)){
+    return -1;
+  }
+
+  memset(dev, 0, sizeof(struct device_spec));
+  strncpy(dev->name, name, CLASS_NAME_LEN - 1);
+
+  if(strcmp(policy, "fifo") == 0){
+    dev->policy = DEVICE_FIFO;
+  }else if(strcmp(policy, "elevator") == 0){
+    dev->policy = DEVICE_ELEVATOR;
+  }else{
+    return -1;
+  }
+
+  if((dist_parse(&dev->service) < 0) || (dev->service.type == DIST_BURSTY)){
+    return -1;
+  }
+
+  //optional seek model
+  const char * tracks = strtok(NULL, " \t\n");
+  const char * seek = strtok(NULL, " \t\n");
+  dev->tracks = (tracks) ? atoi(tracks) : 1;
+  dev->seek = (seek) ? atof(seek) : 0.0;
+  return (dev->tracks > 0) ? 0 : -1;
+}
+
+//Find device by name
+static int device_find(const struct workload * w, const char * name){
+  unsigned int i;
+  for(i=0; i < w->ndevices; i++){
+    if(strcmp(w->devices[i].name, name) == 0){
+      return i;
+    }
+  }
+  return -1;
+}
+
+//Class with defaults, similar to user without a workload
+static void class_init(struct job_class * jc, const char * name, const unsigned int weight){
+  memset(jc, 0, sizeof(struct job_class));
+  strncpy(jc->name, name, CLASS_NAME_LEN - 1);
+  jc->weight = weight;
+  jc->terminate = 10;
+  jc->block = 30;
+  jc->preempt = 30;
+  jc->io.type = DIST_UNIFORM;
+  jc->io.a = 0;
+  jc->io.b = 3000000000.0;
+  jc->device = -1;
+}
+
+int workload_load(struct workload * w, const char * path){
+
+  FILE * fp = fopen(path, "r");
+  if(fp == NULL){
+    perror("fopen");
+    return -1;
+  }
+
+  memset(w, 0, sizeof(struct workload));
+  w->arrival.type = DIST_UNIFORM;
+  w->arrival.b = 500000;
+
+  char line[256];
+  int n = 0, rv = 0;
+  while((rv == 0) && fgets(line, sizeof(line), fp)){
+    n++;
+
+    char * hash = strchr(line, '#');
+    if(hash){
+      *hash = '\0';
+    }
+
+    const char * key = strtok(line, " \t\n");
+    if(key == NULL){
+      continue;
+    }
+
+    struct job_class * jc = (w->nclasses > 0) ? &w->classes[w->nclasses - 1] : NULL;
+
+    if(strcmp(key, "arrival") == 0){
+      rv = dist_parse(&w->arrival);
+
+    }else if(strcmp(key, "device") == 0){
+      if(w->ndevices == MAX_DEVICES){
+        rv = -1;
+      }else{
+        rv = device_parse(&w->devices[w->ndevices++]);
+      }
+
+    }else if(strcmp(key, "class") == 0){
+      const char * name = strtok(NULL, " \t\n");
+      const char * weight = strtok(NULL, " \t\n");
+      if((name == NULL) || (w->nclasses == MAX_CLASSES)){
+        rv = -1;
+      }else{
+        class_init(&w->classes[w->nclasses++], name, (weight) ? atoi(weight) : 1);
+      }
+
+    }else if(jc == NULL){  //rest of settings need a class
+      rv = -1;
+
+    }else if(strcmp(key, "demand") == 0){
+      if((dist_parse(&jc->demand) < 0) || (jc->demand.type == DIST_BURSTY)){
+        rv = -1;
+      }
+      jc->terminate = 0;  //job ends when demand is used
+
+    }else if(strcmp(key, "io") == 0){
+      const char * name = strtok(NULL, " \t\n");
+      jc->device = (name) ? device_find(w, name) : -1;
+      if(jc->device < 0){
+        if((name == NULL) || (dist_parse_named(&jc->io, name) < 0) || (jc->io.type == DIST_BURSTY)){
+          rv = -1;
+        }
+      }
+
+    }else{
+      const char * val = strtok(NULL, " \t\n");
+      if(val == NULL){
+        rv = -1;
+      }else if(strcmp(key, "block") == 0){
+        jc->block = atoi(val);
+      }else if(strcmp(key, "preempt") == 0){
+        jc->preempt = atoi(val);
+      }else if(strcmp(key, "terminate") == 0){
+        jc->terminate = atoi(val);
+      }else{
+        rv = -1;
+      }
+    }
+
+    if((rv == 0) && jc && (jc->terminate + jc->block + jc->preempt > 100)){
+      rv = -1;
+    }
+  }
+  fclose(fp);
+
+  if(rv < 0){
+    fprintf(stderr, "Error: Invalid workload setting at %s:%d\n", path, n);
+    return -1;
+  }
+
+  //without a class, we get one default class
+  if(w->nclasses == 0){
+    class_init(&w->classes[w->nclasses++], "default", 1);
+  }
+  return 0;
+}
+
+uint64_t dist_sample(const struct dist * d, unsigned short seed[3]){
+
+  const double u = erand48(seed);
+  double x = 0.0;
+
+  switch(d->type){
+    case DIST_CONST:    x = d->a;                             break;
+    case DIST_UNIFORM:  x = d->a + (u * (d->b - d->a));       break;
+    case DIST_EXP:      x = -d->a * log(1.0 - u);             break;
+    case DIST_PARETO:   x = d->a / pow(1.0 - u, 1.0 / d->b);  break;
+    case DIST_BURSTY:   x = -d->a * log(1.0 - u);             break;  /* burst mean, state is kept by caller */
+    default:            break;
+  }
+
+  return (x > 0.0) ? (uint64_t) x : 0;
+}
+
+//Time to next arrival, in ns
+uint64_t workload_next_arrival(struct workload * w){
+
+  if(w->arrival.type != DIST_BURSTY){
+    return dist_sample(&w->arrival, w->seed);
+  }
+
+  //two state arrivals, switch between burst and calm rates
+  if(erand48(w->seed) < w->arrival.c){
+    w->bursting = !w->bursting;
+  }
+
+  struct dist d = w->arrival;
+  d.a = (w->bursting) ? w->arrival.a : w->arrival.b;
+  return dist_sample(&d, w->seed);
+}
+
+//Pick class of new job, by weight
+int workload_pick_class(struct workload * w){
+
+  unsigned int i, total = 0;
+  for(i=0; i < w->nclasses; i++){
+    total += w->classes[i].weight;
+  }
+  if(total == 0){
+    return 0;
+  }
+
+  unsigned int r = (unsigned int)(erand48(w->seed) * total);
+  for(i=0; i < w->nclasses; i++){
+    if(r < w->classes[i].weight){
+      return i;
+    }
+    r -= w->classes[i].weight;
+  }
+  return w->nclasses - 1;
+}
@@ -0,0 +1,57 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stdint.h>
+
+//probability distributions, values in ns
+enum dist_type { DIST_NONE=0, DIST_CONST, DIST_UNIFORM, DIST_EXP, DIST_PARETO, DIST_BURSTY };
+
+struct dist {
+	enum dist_type type;
+	double a, b, c;	/* const value | uniform min,max | exp mean | pareto scale,shape | bursty burst mean,calm mean,switch chance */
+};
+
+#define MAX_CLASSES 8
+#define CLASS_NAME_LEN 16
+
+struct job_class {
+	char name[CLASS_NAME_LEN];
+	unsigned int weight;	/* share of arrivals */
+	unsigned int terminate, block, preempt;	/* chance in % per dispatch */
+	struct dist demand;	/* total CPU job needs. With none, job ends on terminate chance */
+	struct dist io;	/* time job blocks on IO */
+	int device;	/* device jobs do IO on, or -1 to block for io time */
+};
+
+#define MAX_DEVICES 8
+
+//order in which device serves its requests
+enum device_policy { DEVICE_FIFO=0, DEVICE_ELEVATOR };
+
+struct device_spec {
+	char name[CLASS_NAME_LEN];
+	enum device_policy policy;
+	struct dist service;	/* transfer time of a request */
+	unsigned int tracks;	/* requests are on random tracks, 1 for no seeking */
+	double seek;	/* ns to move one track */
+};
+
+struct workload {
+	struct dist arrival;	/* time between arrivals */
+	int bursting;	/* bursty arrivals are in burst state */
+	unsigned short seed[3];
+
+	unsigned int nclasses;
+	struct job_class classes[MAX_CLASSES];
+
+	unsigned int ndevices;
+	struct device_spec devices[MAX_DEVICES];
+};
+
+int workload_load(struct workload * w, const char * path);
+
+uint64_t dist_sample(const struct dist * d, unsigned short seed[3]);
+uint64_t workload_next_arrival(struct workload * w);
+int workload_pick_class(struct workload * w);
+
+#endif